@@ -0,0 +1,396 @@
+#include "ContentStore.h"
+#include "Stream.h"
+
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+#include <zlib.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    ::timespec getModifyTime(struct ::stat const& info)
+    {
+#ifdef __APPLE__
+        return info.st_mtimespec;
+#else
+        return info.st_mtim;
+#endif
+    }
+
+    bool sameFile(FileInfo const& file, struct ::stat const& info)
+    {
+        ::timespec  mtime = getModifyTime(info);
+        return file.inode == info.st_ino
+            && file.size == static_cast<std::size_t>(info.st_size)
+            && file.mtime.tv_sec == mtime.tv_sec
+            && file.mtime.tv_nsec == mtime.tv_nsec;
+    }
+
+    std::size_t descriptors(FileInfo const& file)
+    {
+        return (file.fd != -1 ? 1 : 0)
+             + (file.gzip   && file.gzip->fd   != -1 ? 1 : 0)
+             + (file.brotli && file.brotli->fd != -1 ? 1 : 0);
+    }
+
+    std::string gzip(char const* data, std::size_t size)
+    {
+        // windowBits of 15 + 16 asks zlib for a gzip header rather than a zlib header.
+        ::z_stream  stream{};
+        if (::deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Failed to initialize zlib");
+        }
+        std::string result(::deflateBound(&stream, size), '\0');
+        stream.next_in      = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream.avail_in     = size;
+        stream.next_out     = reinterpret_cast<Bytef*>(&result[0]);
+        stream.avail_out    = std::size(result);
+
+        int status = ::deflate(&stream, Z_FINISH);
+        result.resize(stream.total_out);
+        ::deflateEnd(&stream);
+        if (status != Z_STREAM_END) {
+            throw std::runtime_error("Failed to gzip file content");
+        }
+        return result;
+    }
+}
+
+void readFile(int fileFd, char* buffer, std::size_t size, std::size_t offset)
+{
+    while (size != 0)
+    {
+        ::ssize_t readStatus = ::pread(fileFd, buffer, size, offset);
+        if (readStatus == -1 && errno == EINTR) {
+            continue;
+        }
+        if (readStatus == -1) {
+            throw std::runtime_error(Message{} << "Failed to read file: " << fileFd << " Code: " << errno << " " << strerror(errno));
+        }
+        if (readStatus == 0) {
+            throw std::runtime_error(Message{} << "File truncated while reading: " << fileFd);
+        }
+        buffer  += readStatus;
+        offset  += readStatus;
+        size    -= readStatus;
+    }
+}
+
+void writeFile(int fileFd, char const* buffer, std::size_t size)
+{
+    while (size != 0)
+    {
+        ::ssize_t writeStatus = ::write(fileFd, buffer, size);
+        if (writeStatus == -1 && errno == EINTR) {
+            continue;
+        }
+        if (writeStatus == -1) {
+            throw std::runtime_error(Message{} << "Failed to write file: " << fileFd << " Code: " << errno << " " << strerror(errno));
+        }
+        buffer  += writeStatus;
+        size    -= writeStatus;
+    }
+}
+
+// FileInfo
+// ========
+FileInfo::FileInfo(std::filesystem::path path, int fd, struct ::stat const& info, bool watched)
+    : path{std::move(path)}
+    , fd{fd}
+    , size{static_cast<std::size_t>(info.st_size)}
+    , mtime{getModifyTime(info)}
+    , inode{info.st_ino}
+    , watched{watched}
+{}
+
+FileInfo::~FileInfo()
+{
+    if (fd != -1) {
+        ::close(fd);
+    }
+}
+
+// ContentStore
+// ============
+ContentStore::ContentStore(std::filesystem::path const& contentDir, ContentConfig const& config)
+    : contentDir{contentDir}
+    , maxEntries{config.maxEntries}
+    , maxOpenFiles{config.maxOpenFiles}
+    , revalidateAfter{config.revalidateAfter}
+    , watchContent{config.watchContent}
+    , precompressed{config.precompressed}
+    , compressOnDemand{config.compressOnDemand}
+    , responseCache{config.responseCacheBytes, config.responseCacheFile, config.revalidateAfter}
+    , compressedCache{config.compressCacheBytes, config.compressMaxFile, config.revalidateAfter}
+    , openFiles{0}
+    , changes{0}
+    , watcher{[&](std::filesystem::path const& changed){invalidate(changed);}}
+{}
+
+FileInfoPtr ContentStore::find(std::filesystem::path const& requestPath)
+{
+    std::string     key = requestPath.string();
+    std::size_t     reserved;
+    std::uint64_t   generation;
+    {
+        std::unique_lock    lock(cacheMutex);
+        auto find = entries.find(key);
+        if (find != std::end(entries))
+        {
+            lru.splice(std::begin(lru), lru, find->second);
+            Entry&      entry   = *find->second;
+            FileInfoPtr info    = entry.info;
+            if (info->watched || Clock::now() - entry.validatedAt < revalidateAfter) {
+                return info;
+            }
+
+            // Don't hold the lock while we make a system call.
+            lock.unlock();
+            bool valid = stillValid(*info);
+            lock.lock();
+
+            // Another thread may have changed the entry while we were unlocked.
+            find = entries.find(key);
+            bool unchanged = find != std::end(entries) && find->second->info == info;
+            if (valid) {
+                if (unchanged) {
+                    find->second->validatedAt = Clock::now();
+                }
+                return info;
+            }
+            if (unchanged) {
+                erase(find);
+            }
+        }
+        // Reserve the descriptors this entry may keep (the file and its ".gz" and ".br" variants).
+        // So threads resolving at the same time can not take the cache past maxOpenFiles.
+        reserved    = std::min<std::size_t>(maxOpenFiles - std::min(openFiles, maxOpenFiles), precompressed ? 3 : 1);
+        openFiles  += reserved;
+        generation  = changes;
+    }
+
+    FileInfoPtr info = resolve(requestPath, reserved);
+    insert(key, info, generation, reserved);
+    return info;
+}
+
+FileInfoPtr ContentStore::resolve(std::filesystem::path const& requestPath, std::size_t maxOpen)
+{
+    std::error_code         ec;
+    std::filesystem::path   filePath = std::filesystem::canonical(std::filesystem::path{contentDir} /= requestPath, ec);
+    if (ec) {
+        return nullptr;
+    }
+
+    // Note: The directory is watched before we look at the file.
+    //       So there is no gap where a change could be missed.
+    bool                        watched     = watchDirectories(filePath.parent_path());
+    bool                        isDirectory = false;
+    std::shared_ptr<FileInfo>   info        = openFile(filePath, maxOpen != 0, watched, isDirectory);
+
+    // If it is a directory then use the "index.html" file inside it.
+    if (isDirectory)
+    {
+        filePath = std::filesystem::canonical(filePath /= "index.html", ec);
+        if (ec) {
+            return nullptr;
+        }
+        watched = watchDirectories(filePath.parent_path());
+        info    = openFile(filePath, maxOpen != 0, watched, isDirectory);
+    }
+
+    // Pick up any pre-compressed versions that sit beside the file.
+    // They are kept open with whatever is left of "maxOpen" after the file itself.
+    if (info && precompressed)
+    {
+        info->gzip      = openFile(info->path.native() + ".gz", descriptors(*info) < maxOpen, watched, isDirectory);
+        info->brotli    = openFile(info->path.native() + ".br", descriptors(*info) < maxOpen, watched, isDirectory);
+    }
+    return info;
+}
+
+std::shared_ptr<FileInfo> ContentStore::openFile(std::filesystem::path const& filePath, bool keepOpen, bool watched, bool& isDirectory)
+{
+    // Open the file and use fstat() to get the type, size and modify time in one call.
+    // If we can not keep the descriptor a stat() is enough (the file is never opened).
+    isDirectory = false;
+    int             fd = -1;
+    struct ::stat   info;
+    if (keepOpen)
+    {
+        fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return nullptr;
+        }
+        if (::fstat(fd, &info) == -1) {
+            ::close(fd);
+            return nullptr;
+        }
+    }
+    else if (::stat(filePath.c_str(), &info) == -1) {
+        return nullptr;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        isDirectory = S_ISDIR(info.st_mode);
+        if (fd != -1) {
+            ::close(fd);
+        }
+        return nullptr;
+    }
+    return std::make_shared<FileInfo>(filePath, fd, info, watched);
+}
+
+bool ContentStore::compressible(FileInfo const& file) const
+{
+    static std::array<std::string_view, 12> const textTypes = {".html", ".htm", ".css", ".js", ".mjs", ".json", ".map", ".txt", ".csv", ".md", ".svg", ".xml"};
+
+    if (!compressOnDemand || file.size > compressedCache.maxSize()) {
+        return false;
+    }
+    std::string extension = file.path.extension().string();
+    return std::find(std::begin(textTypes), std::end(textTypes), extension) != std::end(textTypes);
+}
+
+ResponseCache::Response ContentStore::compress(FileInfo const& file)
+{
+    if (!compressible(file)) {
+        return nullptr;
+    }
+
+    // The key includes the identity of the file (the same as the entity tag).
+    // So content read from a file that has since been replaced can never be returned for the new file.
+    std::uint64_t const     generation  = compressedCache.generation();
+    std::string             key         = Message{} << file.path.native() << '\0' << file.inode << '-' << file.size << '-' << file.mtime.tv_sec << '.' << file.mtime.tv_nsec;
+    ResponseCache::Response cached      = compressedCache.find(key);
+    if (cached) {
+        return cached;
+    }
+
+    // Use the cached descriptor if there is one.
+    int fd = file.fd != -1 ? file.fd : ::open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    std::string content(file.size, '\0');
+    try
+    {
+        readFile(fd, &content[0], file.size, 0);
+    }
+    catch (...)
+    {
+        if (fd != file.fd) {
+            ::close(fd);
+        }
+        throw;
+    }
+    if (fd != file.fd) {
+        ::close(fd);
+    }
+
+    ResponseCache::Response compressed = std::make_shared<std::string const>(gzip(std::data(content), std::size(content)));
+    compressedCache.insert(key, file.path, compressed, file.watched, generation);
+    return compressed;
+}
+
+bool ContentStore::watchDirectories(std::filesystem::path const& dir)
+{
+    if (!watchContent) {
+        return false;
+    }
+    // Watch every directory from "dir" up to contentDir.
+    // So renaming or removing any of them is also noticed.
+    bool                    watched = true;
+    std::filesystem::path   current = dir;
+    while (true)
+    {
+        watched = watcher.watch(current) && watched;
+        if (current == contentDir || !ContentWatcher::affects(contentDir, current)) {
+            break;
+        }
+        current = current.parent_path();
+    }
+    return watched;
+}
+
+void ContentStore::invalidate(std::filesystem::path const& changed)
+{
+    // A change to a pre-compressed variant changes the responses for the original file.
+    std::filesystem::path   extension = changed.extension();
+    if (precompressed && (extension == ".gz" || extension == ".br")) {
+        invalidate(std::filesystem::path{changed}.replace_extension());
+    }
+
+    // Drop the FileInfo entries before the responses built from them.
+    // A request that found an entry before it was dropped read its generation of the
+    // response caches before that. So the invalidate() below stops it caching the response.
+    {
+        std::unique_lock    lock(cacheMutex);
+        ++changes;
+        for (auto loop = std::begin(lru); loop != std::end(lru);)
+        {
+            auto next = std::next(loop);
+            if (ContentWatcher::affects(changed, loop->info->path)) {
+                erase(entries.find(loop->key));
+            }
+            loop = next;
+        }
+    }
+
+    compressedCache.invalidate(changed);
+    responseCache.invalidate(changed);
+}
+
+bool ContentStore::stillValid(FileInfo const& file)
+{
+    if (file.gzip && !stillValid(*file.gzip)) {
+        return false;
+    }
+    if (file.brotli && !stillValid(*file.brotli)) {
+        return false;
+    }
+
+    struct ::stat   info;
+    if (file.fd != -1)
+    {
+        // A file that has been deleted (or replaced by a rename) has no links.
+        return ::fstat(file.fd, &info) == 0 && info.st_nlink != 0 && sameFile(file, info);
+    }
+    return ::stat(file.path.c_str(), &info) == 0 && sameFile(file, info);
+}
+
+void ContentStore::insert(std::string const& key, FileInfoPtr info, std::uint64_t generation, std::size_t reserved)
+{
+    std::unique_lock    lock(cacheMutex);
+    openFiles -= reserved;
+    if (!info) {
+        return;
+    }
+    if (changes != generation) {
+        // Something changed while it was resolved: The invalidation may have been for this file.
+        return;
+    }
+    if (entries.find(key) != std::end(entries)) {
+        // Another thread got here first.
+        return;
+    }
+
+    lru.push_front(Entry{key, info, Clock::now()});
+    entries.emplace(key, std::begin(lru));
+    openFiles += descriptors(*info);
+
+    while (std::size(entries) > maxEntries) {
+        erase(entries.find(lru.back().key));
+    }
+}
+
+void ContentStore::erase(EntryMap::iterator find)
+{
+    openFiles -= descriptors(*find->second->info);
+    lru.erase(find->second);
+    entries.erase(find);
+}
@@ -0,0 +1,164 @@
+#ifndef CONTENT_STORE_H
+#define CONTENT_STORE_H
+
+/*
+ * ContentStore:    Maps request paths onto files in the content directory.
+ *
+ * Turning a request path into a file (realpath, is_directory, index.html, is_regular_file,
+ * open, size) takes a lot of system calls. So the result is cached as a FileInfo object
+ * that holds the resolved path, an open file descriptor, the size and modification time.
+ *
+ * The directories of each cached file are registered with a ContentWatcher (inotify) which
+ * drops the affected entries as soon as anything changes. So a watched entry is used with no
+ * system calls at all. If a directory could not be watched the entry is trusted for
+ * "revalidateAfter". After that the next user checks it with a single fstat() (or stat() if we
+ * have no descriptor). If the file has changed or been removed the entry is dropped and the
+ * path resolved again.
+ * A path is resolved without holding the lock. If anything is invalidated while it is being
+ * resolved the result is used for that request but is not cached (as the change may have been
+ * reported before the entry was inserted, it would never be dropped).
+ *
+ * The cache is bounded by the number of entries and by the number of descriptors it keeps
+ * open (a file and its pre-compressed variants count separately). Once the descriptor budget
+ * is used new entries are cached without a descriptor and the user must open the file itself. When full the least recently used entry is dropped.
+ * A FileInfo is held by std::shared_ptr so a request that is using an entry keeps it alive
+ * (and its descriptor open) even if it is removed from the cache.
+ *
+ * Pre-compressed variants: If "file.gz" or "file.br" exist next to a file they are resolved
+ * at the same time and attached to its FileInfo (so they are cached and invalidated together).
+ * Optionally (compressOnDemand) text files without a ".gz" variant are gzipped the first time
+ * they are requested and the result kept in a byte budgeted cache (see compress()).
+ *
+ * The store also owns the ResponseCache used to hold complete responses for small files.
+ *
+ * All public methods are thread safe.
+ */
+
+#include "ResponseCache.h"
+#include "ContentWatcher.h"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <ctime>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct FileInfo;
+using FileInfoPtr = std::shared_ptr<FileInfo const>;
+
+struct FileInfo
+{
+    FileInfo(std::filesystem::path path, int fd, struct ::stat const& info, bool watched);
+    ~FileInfo();
+
+    FileInfo(FileInfo const&)               = delete;
+    FileInfo& operator=(FileInfo const&)    = delete;
+
+    std::filesystem::path   path;
+    int                     fd;         // -1 if the cache did not keep the file open.
+    std::size_t             size;
+    ::timespec              mtime;
+    ::ino_t                 inode;
+    bool                    watched;    // Changes are reported by the ContentWatcher.
+    FileInfoPtr             gzip;       // "<path>.gz"   if it exists.
+    FileInfoPtr             brotli;     // "<path>.br"   if it exists.
+};
+
+struct ContentConfig
+{
+    // Path resolution cache.
+    std::size_t                 maxEntries          = 1024;
+    std::size_t                 maxOpenFiles        = 256;
+    std::chrono::milliseconds   revalidateAfter     {1000};
+    bool                        watchContent        = true;
+    // Complete response cache.
+    std::size_t                 responseCacheBytes  = 64 * 1024 * 1024;
+    std::size_t                 responseCacheFile   = 64 * 1024;
+    // Compressed variants.
+    bool                        precompressed       = true;
+    bool                        compressOnDemand    = false;
+    std::size_t                 compressCacheBytes  = 64 * 1024 * 1024;
+    std::size_t                 compressMaxFile     = 8 * 1024 * 1024;
+};
+
+// Read exactly "size" bytes of a file at "offset" into "buffer".
+void readFile(int fileFd, char* buffer, std::size_t size, std::size_t offset);
+// Write all of "buffer" to a file.
+void writeFile(int fileFd, char const* buffer, std::size_t size);
+
+class ContentStore
+{
+    using Clock     = std::chrono::steady_clock;
+    struct Entry
+    {
+        std::string         key;
+        FileInfoPtr         info;
+        Clock::time_point   validatedAt;
+    };
+    using LRUList   = std::list<Entry>;
+    using EntryMap  = std::unordered_map<std::string, LRUList::iterator>;
+
+    std::filesystem::path const     contentDir;
+    std::size_t const               maxEntries;
+    std::size_t const               maxOpenFiles;
+    Clock::duration const           revalidateAfter;
+    bool const                      watchContent;
+    bool const                      precompressed;
+    bool const                      compressOnDemand;
+    ResponseCache                   responseCache;
+    ResponseCache                   compressedCache;
+
+    std::mutex                      cacheMutex;
+    LRUList                         lru;            // Most recently used at the front.
+    EntryMap                        entries;
+    std::size_t                     openFiles;
+    std::uint64_t                   changes;        // Incremented by invalidate().
+
+    // Declared last so it is destroyed first.
+    // Its thread calls invalidate() which uses all the members above.
+    ContentWatcher                  watcher;
+
+    public:
+        ContentStore(std::filesystem::path const& contentDir, ContentConfig const& config = ContentConfig{});
+
+        ContentStore(ContentStore const&)               = delete;
+        ContentStore& operator=(ContentStore const&)    = delete;
+
+        std::filesystem::path const& getContentDir() const {return contentDir;}
+        ResponseCache&               getResponseCache()    {return responseCache;}
+        ResponseCache const&         getCompressedCache() const {return compressedCache;}
+
+        // "requestPath" must be lexically normal and relative to contentDir.
+        // Returns nullptr if there is no regular file for this path.
+        FileInfoPtr find(std::filesystem::path const& requestPath);
+
+        // Returns true if compress() would produce a gzipped version of this file.
+        bool        compressible(FileInfo const& file) const;
+        // Returns the gzipped content of the file (compressed once then cached).
+        // Returns nullptr if the file is not compressible or compressOnDemand is off.
+        ResponseCache::Response compress(FileInfo const& file);
+
+        // Drop any cached information about "changed" (or anything inside it if it is a directory).
+        void        invalidate(std::filesystem::path const& changed);
+
+    private:
+        // Keeps at most "maxOpen" descriptors (the file first, then its variants).
+        FileInfoPtr resolve(std::filesystem::path const& requestPath, std::size_t maxOpen);
+        std::shared_ptr<FileInfo> openFile(std::filesystem::path const& filePath, bool keepOpen, bool watched, bool& isDirectory);
+        bool        watchDirectories(std::filesystem::path const& dir);
+        bool        stillValid(FileInfo const& info);
+        // "generation" is the value of "changes" before the path was resolved.
+        // Releases the "reserved" descriptors (find()) and counts those "info" keeps if it is cached.
+        void        insert(std::string const& key, FileInfoPtr info, std::uint64_t generation, std::size_t reserved);
+        void        erase(EntryMap::iterator find);
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "ContentWatcher.h"
+#include "Logger.h"
+
+#include <vector>
+#include <cstring>
+
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#ifdef __linux__
+
+ContentWatcher::ContentWatcher(Invalidate&& invalidate)
+    : invalidate{std::move(invalidate)}
+    , inotifyFd{::inotify_init1(IN_CLOEXEC)}
+    , stopPipe{-1, -1}
+{
+    if (inotifyFd == -1) {
+        NISSE_LOG(Error, "Failed to create inotify: ", errno, " ", strerror(errno));
+        return;
+    }
+    if (::pipe(stopPipe) == -1) {
+        NISSE_LOG(Error, "Failed to create inotify stop pipe: ", errno, " ", strerror(errno));
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        return;
+    }
+    watcher = std::thread(&ContentWatcher::processEvents, this);
+}
+
+ContentWatcher::~ContentWatcher()
+{
+    if (watcher.joinable())
+    {
+        char stop = 0;
+        while (::write(stopPipe[1], &stop, 1) == -1 && errno == EINTR)
+        {}
+        watcher.join();
+    }
+    for (int fd: {inotifyFd, stopPipe[0], stopPipe[1]})
+    {
+        if (fd != -1) {
+            ::close(fd);
+        }
+    }
+}
+
+bool ContentWatcher::watch(std::filesystem::path const& dir)
+{
+    if (inotifyFd == -1) {
+        return false;
+    }
+
+    std::string const&  name = dir.native();
+    std::unique_lock    lock(watchMutex);
+    if (dirToWatch.find(name) != std::end(dirToWatch)) {
+        return true;
+    }
+
+    static constexpr std::uint32_t watchEvents = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE
+                                               | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    int wd = ::inotify_add_watch(inotifyFd, name.c_str(), watchEvents);
+    if (wd == -1) {
+        // Usually ENOSPC (out of watches). The caller will validate the files manually.
+        return false;
+    }
+    watchToDir[wd]      = name;
+    dirToWatch[name]    = wd;
+    return true;
+}
+
+void ContentWatcher::processEvents()
+{
+    // Buffer must be aligned for inotify_event and big enough for a batch of events.
+    alignas(::inotify_event) char   buffer[64 * 1024];
+
+    while (true)
+    {
+        ::pollfd    fds[2] = {{inotifyFd, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+        int pollStatus = ::poll(fds, 2, -1);
+        if (pollStatus == -1 && errno == EINTR) {
+            continue;
+        }
+        if (pollStatus == -1 || fds[1].revents != 0) {
+            break;
+        }
+
+        ::ssize_t readStatus = ::read(inotifyFd, buffer, sizeof(buffer));
+        if (readStatus == -1 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (readStatus <= 0) {
+            NISSE_LOG(Error, "Failed to read inotify: ", errno, " ", strerror(errno));
+            break;
+        }
+
+        for (char* next = buffer; next < buffer + readStatus;)
+        {
+            ::inotify_event const& event = *reinterpret_cast<::inotify_event const*>(next);
+            handleEvent(event.wd, event.mask, event.len != 0 ? event.name : nullptr);
+            next += sizeof(::inotify_event) + event.len;
+        }
+    }
+}
+
+void ContentWatcher::handleEvent(int wd, std::uint32_t mask, char const* name)
+{
+    if (mask & IN_Q_OVERFLOW) {
+        // We lost events so we don't know what changed: Drop everything.
+        invalidate("/");
+        return;
+    }
+
+    std::string dir;
+    {
+        std::unique_lock    lock(watchMutex);
+        auto find = watchToDir.find(wd);
+        if (find == std::end(watchToDir)) {
+            return;
+        }
+        dir = find->second;
+        if (mask & (IN_IGNORED | IN_MOVE_SELF)) {
+            forget(dir);
+        }
+    }
+
+    if (name == nullptr || (mask & (IN_IGNORED | IN_MOVE_SELF | IN_DELETE_SELF))) {
+        invalidate(dir);
+    }
+    else {
+        invalidate(std::filesystem::path{dir} /= name);
+    }
+}
+
+void ContentWatcher::forget(std::string const& dir)
+{
+    // Called with "watchMutex" held.
+    // The directory is gone (or its path is no longer valid). So are the paths of the
+    // directories inside it: Their watches follow the old inodes, so if the tree is recreated
+    // under the same names the new files would look watched. Forget them all. They will be
+    // watched again if we cache anything inside them.
+    for (auto loop = std::begin(dirToWatch); loop != std::end(dirToWatch);)
+    {
+        if (!affects(dir, loop->first)) {
+            ++loop;
+            continue;
+        }
+        // Fails harmlessly if the kernel already removed the watch (IN_IGNORED).
+        ::inotify_rm_watch(inotifyFd, loop->second);
+        watchToDir.erase(loop->second);
+        loop = dirToWatch.erase(loop);
+    }
+}
+
+#else
+
+ContentWatcher::ContentWatcher(Invalidate&& invalidate)
+    : invalidate{std::move(invalidate)}
+    , inotifyFd{-1}
+    , stopPipe{-1, -1}
+{}
+
+ContentWatcher::~ContentWatcher()
+{}
+
+bool ContentWatcher::watch(std::filesystem::path const&)
+{
+    return false;
+}
+
+void ContentWatcher::processEvents()
+{}
+
+void ContentWatcher::handleEvent(int, std::uint32_t, char const*)
+{}
+
+#endif
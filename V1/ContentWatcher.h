@@ -0,0 +1,70 @@
+#ifndef CONTENT_WATCHER_H
+#define CONTENT_WATCHER_H
+
+/*
+ * ContentWatcher:  Uses Linux inotify to report changes to files in directories we care about.
+ *
+ * Directories are not registered up front (walking a large content tree is slow).
+ * Instead the ContentStore calls watch() for the directories of each file it caches.
+ * A background thread reads the inotify events and calls the "invalidate" callback with
+ * the full path of whatever was modified, created, deleted or renamed. If a directory
+ * itself is removed or renamed the callback is given the directory path, and the watches on
+ * it and on every directory inside it are dropped.
+ *
+ * If watch() returns false (not Linux, or we have run out of inotify watches) the
+ * caller must fall back to checking the file itself.
+ *
+ * All public methods are thread safe.
+ */
+
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+
+class ContentWatcher
+{
+    public:
+        using Invalidate = std::function<void(std::filesystem::path const& changed)>;
+
+    private:
+        Invalidate                              invalidate;
+        int                                     inotifyFd;
+        int                                     stopPipe[2];
+        std::mutex                              watchMutex;
+        std::unordered_map<int, std::string>    watchToDir;
+        std::unordered_map<std::string, int>    dirToWatch;
+        std::thread                             watcher;
+
+    public:
+        ContentWatcher(Invalidate&& invalidate);
+        ~ContentWatcher();
+
+        ContentWatcher(ContentWatcher const&)               = delete;
+        ContentWatcher& operator=(ContentWatcher const&)    = delete;
+
+        // Start watching "dir" (if we are not already). Cheap if it is already watched.
+        bool watch(std::filesystem::path const& dir);
+
+        // Is "path" the same as "changed" or inside the directory "changed".
+        static bool affects(std::filesystem::path const& changed, std::filesystem::path const& path)
+        {
+            std::string_view    change  = changed.native();
+            std::string_view    check   = path.native();
+            if (!check.starts_with(change)) {
+                return false;
+            }
+            return std::size(check) == std::size(change) || change.ends_with('/') || check[std::size(change)] == '/';
+        }
+
+    private:
+        void processEvents();
+        void handleEvent(int wd, std::uint32_t mask, char const* name);
+        void forget(std::string const& dir);
+};
+
+#endif
@@ -1,122 +1,352 @@
-#include "Stream.h"
+#include "HTTPStuff.h"
+#include "Scanner.h"
+#include "ContentStore.h"
+#include "Logger.h"
 
-#include <iostream>
-#include <fstream>
 #include <string>
 #include <string_view>
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <cctype>
+#include <span>
+#include <charconv>
+#include <cstring>
+#include <ctime>
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/uio.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <unistd.h>
 
-/*
- * Class Declarations:
- *
- *      ErrorStatus:        Error state that is reported back on each request.
- *      HttpRequest:        An HTTP request object that has been read from a 'Stream'.
- *      HttpResponse:       An HTTP response object that can be written to a 'Stream' in
- *                          response to an HttpRequest.
- */
-
-struct ErrorStatus
+namespace
 {
-    ErrorStatus()
-        : errorCode{200}
-        , errorMessage{"OK"}
-    {}
+    bool equalNoCase(std::string_view lhs, std::string_view rhs)
+    {
+        return std::size(lhs) == std::size(rhs)
+            && std::equal(std::begin(lhs), std::end(lhs), std::begin(rhs), [](char l, char r){return std::tolower(static_cast<unsigned char>(l)) == std::tolower(static_cast<unsigned char>(r));});
+    }
 
-    int             errorCode;
-    std::string     errorMessage;
-    std::string     humanInformation;
-};
+    std::string_view trim(std::string_view value)
+    {
+        std::size_t first   = value.find_first_not_of(" \t");
+        std::size_t last    = value.find_last_not_of(" \t");
+        return (first == std::string_view::npos) ? std::string_view{} : value.substr(first, last - first + 1);
+    }
 
-class HttpRequest
-{
-    ErrorStatus     status;
+    bool parseNumber(std::string_view text, std::size_t& value)
+    {
+        auto [ptr, ec] = std::from_chars(std::begin(text), std::end(text), value);
+        return ec == std::errc{} && ptr == std::end(text);
+    }
 
-    std::string     method;
-    std::string     URI;
-    std::string     version;
+    // Parse an HTTP date (only the IMF-fixdate format is supported).
+    bool parseHttpDate(std::string_view text, std::time_t& time)
+    {
+        char    buffer[64];
+        if (text.empty() || std::size(text) >= sizeof(buffer)) {
+            return false;
+        }
+        std::copy(std::begin(text), std::end(text), buffer);
+        buffer[std::size(text)] = '\0';
+
+        ::tm        parts{};
+        char const* end = ::strptime(buffer, "%a, %d %b %Y %H:%M:%S GMT", &parts);
+        if (end == nullptr || *end != '\0') {
+            return false;
+        }
+        time = ::timegm(&parts);
+        return true;
+    }
 
-    public:
-        HttpRequest(Stream& socket);
-        ErrorStatus const&  getStatus()         const   {return status;}
-        std::string const&  getURI()            const   {return URI;}
-        bool isValid() const {return status.errorCode == 200;}
+    // Does "etag" match any of the tags in an If-None-Match list (weak comparison).
+    bool matchEntityTag(std::string_view list, std::string_view etag)
+    {
+        if (trim(list) == "*") {
+            return true;
+        }
+        while (!list.empty())
+        {
+            std::size_t         comma   = list.find(',');
+            std::string_view    item    = trim(list.substr(0, comma));
+            list = (comma == std::string_view::npos) ? std::string_view{} : list.substr(comma + 1);
+            if (item.starts_with("W/")) {
+                item.remove_prefix(2);
+            }
+            if (item == etag) {
+                return true;
+            }
+        }
+        return false;
+    }
 
-    private:
-        std::tuple<std::string, std::string>                splitHeader(std::string_view header);
-        std::tuple<std::string, std::string, std::string>   splitFirstLine(std::string_view firstLine);
-};
+    // Is the parameter list "q=0", "q=0.0" etc.
+    bool zeroQuality(std::string_view params)
+    {
+        params = trim(params);
+        if (std::size(params) < 3 || (params[0] != 'q' && params[0] != 'Q') || params[1] != '=') {
+            return false;
+        }
+        std::string_view    quality = trim(params.substr(2));
+        return !quality.empty() && quality[0] == '0' && quality.find_first_not_of("0.") == std::string_view::npos;
+    }
+}
 
-class HttpResponse
+// Stream
+// ======
+void Stream::sendFileRange(int fileFd, std::size_t offset, std::size_t size)
 {
-    HttpRequest const&  request;
-    ErrorStatus         status;
+    // Generic version that works for any stream.
+    // Read the file in large blocks (not lines) and push each block through sendMessage().
+    static constexpr std::size_t    copyBufferSize = 64 * 1024;
 
-    public:
-        HttpResponse(HttpRequest const& request);
+    std::string buffer;
+    while (size != 0)
+    {
+        buffer.resize(std::min(size, copyBufferSize));
+        ::ssize_t readStatus = ::pread(fileFd, &buffer[0], std::size(buffer), offset);
+        if (readStatus == -1 && errno == EINTR) {
+            continue;
+        }
+        if (readStatus == -1) {
+            throw std::runtime_error(Message{} << "Failed to read file: " << fileFd << " Code: " << errno << " " << strerror(errno));
+        }
+        if (readStatus == 0) {
+            throw std::runtime_error(Message{} << "File truncated while sending: " << fileFd);
+        }
+        buffer.resize(readStatus);
+        sendMessage(buffer);
+        offset  += readStatus;
+        size    -= readStatus;
+    }
+}
 
-        bool isValid() const {return status.errorCode == 200;}
-        void send(Stream& socket, std::filesystem::path const& contentDir);
-    private:
-        std::filesystem::path getFilePath(std::filesystem::path const& contentDir);
-};
+std::size_t Stream::spliceTo(int fileFd, std::size_t size)
+{
+    // Generic version that works for any stream.
+    // Copy through a fixed size buffer so the body is never held in memory.
+    static constexpr std::size_t    copyBufferSize = 64 * 1024;
+
+    std::vector<char>   buffer(std::min(size, copyBufferSize));
+    std::size_t         written = 0;
+    while (written != size)
+    {
+        std::size_t amountRead = readBody(&buffer[0], std::min(size - written, std::size(buffer)));
+        if (amountRead == 0) {
+            break;
+        }
+        writeFile(fileFd, &buffer[0], amountRead);
+        written += amountRead;
+    }
+    return written;
+}
+
+// OpenFile
+// ========
+OpenFile::OpenFile(FileInfoPtr fileInfo)
+    : info{std::move(fileInfo)}
+    , fd{-1}
+{
+    if (info) {
+        fd = info->fd != -1 ? info->fd : ::open(info->path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+}
+
+OpenFile::~OpenFile()
+{
+    // Only close the descriptor if we opened it.
+    if (fd != -1 && fd != info->fd) {
+        ::close(fd);
+    }
+}
 
 // HttpRequest
 // ===========
-HttpRequest::HttpRequest(Stream& socket)
+bool HttpRequest::setFirstLine(std::string_view line, LineInfo const& info)
 {
     using std::literals::operator""sv;
-    using std::literals::operator""s;
 
-    std::size_t      bodySize       = 0;
-    std::string_view firstLine      = socket.getNextLine();
-    std::tie(method, URI, version)  = splitFirstLine(firstLine);
-    if (method != "GET"s) {
+    std::string_view firstLine      = storeLine(line);
+    if (status.errorCode != 200) {
+        return false;
+    }
+    std::tie(method, URI, version)  = splitFirstLine(firstLine, info);
+    if (method != "GET"sv) {
         status.errorCode = 405;
         status.errorMessage = "Method Not Allowed";
         status.humanInformation = Message{} << "HTTP method '" << method << "' is not supported";
-        firstLine.remove_suffix(2);
-        std::clog << "  Bad Request: Not A GET: " << firstLine << "\n";
-        return;
+        firstLine.remove_suffix(std::min<std::size_t>(2, std::size(firstLine)));
+        NISSE_LOG(Warning, "  Bad Request: Not A GET: ", firstLine);
+        return false;
     }
-    if (version != "HTTP/1.1") {
+    if (version != "HTTP/1.1"sv) {
         status.errorCode = 400;
         status.errorMessage = "Bad Request";
         status.humanInformation = Message{} << "HTTP version '" << version << "' is not supported";
-        std::clog << "  Bad Request: Not HTTP/1.1: " << firstLine << "\n";
+        NISSE_LOG(Warning, "  Bad Request: Not HTTP/1.1: ", firstLine);
+        return false;
+    }
+    return true;
+}
+
+void HttpRequest::addHeader(std::string_view line, LineInfo const& info)
+{
+    std::string_view header = storeLine(line);
+    if (status.errorCode != 200) {
+        return;
+    }
+    if (headerCount == maxHeaderCount) {
+        status.errorCode = 431;
+        status.errorMessage = "Request Header Fields Too Large";
+        status.humanInformation = Message{} << "More than " << maxHeaderCount << " headers";
+        NISSE_LOG(Warning, "  Bad Request: Too many headers");
         return;
     }
+    auto [name, value] = splitHeader(header, info);
+    headers[headerCount++] = {name, value};
+}
+
+std::size_t HttpRequest::finishHeaders()
+{
+    // All the headers have been read: Extract the ones we use.
+    // Returns the size of the body.
+    std::size_t      size           = 0;
+    std::string_view contentLength  = getHeader("content-length");
+    if (!contentLength.empty() && !parseNumber(contentLength, size))
+    {
+        status.errorCode = 400;
+        status.errorMessage = "Bad Request";
+        status.humanInformation = Message{} << "Invalid content-length '" << contentLength << "'";
+        NISSE_LOG(Warning, "  Bad Request: Invalid content-length: ", contentLength);
+        return 0;
+    }
+
+    acceptEncoding  = parseAcceptEncoding(getHeader("accept-encoding"));
+    parseRange(getHeader("range"));
+    ifRange         = getHeader("if-range");
+    ifNoneMatch     = getHeader("if-none-match");
+    ifModifiedSince = getHeader("if-modified-since");
+
+    NISSE_LOG(Info, "  Request: ", method, " ", URI, " ", version, " Body: ", size);
+    return size;
+}
+
+std::string_view HttpRequest::getHeader(std::string_view name) const
+{
+    for (Header const& header: getHeaders())
+    {
+        if (equalNoCase(header.name, name)) {
+            return header.value;
+        }
+    }
+    return {};
+}
 
-    std::string_view header;
-    while (status.errorCode == 200 && (header = socket.getNextLine()) != "\r\n"sv)
+int HttpRequest::parseAcceptEncoding(std::string_view value)
+{
+    // Accept-Encoding: gzip, br;q=0.8, *;q=0
+    // A coding with a quality of zero is refused. "*" covers any coding not named explicitly.
+    // We only need to know what is acceptable (not the preference order). As the server
+    // always prefers the smallest body (br then gzip) the other quality values are ignored.
+    int     named       = 0;
+    int     accepted    = 0;
+    bool    anyAccepted = false;
+    while (!value.empty())
     {
-        auto [name, value] = splitHeader(header);
-        if (name == "content-length"s) {
-            bodySize = std::stoi(value);
+        std::size_t         comma   = value.find(',');
+        std::string_view    item    = value.substr(0, comma);
+        value = (comma == std::string_view::npos) ? std::string_view{} : value.substr(comma + 1);
+
+        std::size_t         semi    = item.find(';');
+        std::string_view    coding  = trim(item.substr(0, semi));
+        bool                refused = semi != std::string_view::npos && zeroQuality(item.substr(semi + 1));
+
+        if (coding == "*") {
+            anyAccepted = !refused;
+            continue;
+        }
+        int encoding = (equalNoCase(coding, "gzip") || equalNoCase(coding, "x-gzip"))   ? Gzip
+                     : equalNoCase(coding, "br")                                         ? Brotli
+                     :                                                                     Identity;
+        named |= encoding;
+        if (!refused) {
+            accepted |= encoding;
         }
     }
-    if (status.errorCode != 200) {
+    return accepted | (anyAccepted ? ((Gzip | Brotli) & ~named) : 0);
+}
+
+void HttpRequest::parseRange(std::string_view value)
+{
+    // Range: bytes=0-499, 1000-, -500
+    // A Range header we can not parse (or one with too many ranges) is ignored.
+    // So the whole file is sent (as required by RFC 9110).
+    using std::literals::operator""sv;
+
+    value = trim(value);
+    if (!value.starts_with("bytes="sv)) {
         return;
     }
+    value.remove_prefix(std::size("bytes="sv));
+
+    std::size_t count = 0;
+    while (!value.empty())
+    {
+        std::size_t         comma   = value.find(',');
+        std::string_view    item    = trim(value.substr(0, comma));
+        value = (comma == std::string_view::npos) ? std::string_view{} : value.substr(comma + 1);
+        if (item.empty()) {
+            continue;
+        }
+
+        std::size_t         dash    = item.find('-');
+        if (count == maxRanges || dash == std::string_view::npos) {
+            return;
+        }
+        std::string_view    first   = item.substr(0, dash);
+        std::string_view    last    = item.substr(dash + 1);
+        ByteRange           range{std::string_view::npos, std::string_view::npos};
+        if ((first.empty() && last.empty())
+            || (!first.empty() && !parseNumber(first, range.first))
+            || (!last.empty() && !parseNumber(last, range.last))
+            || (!first.empty() && !last.empty() && range.last < range.first))
+        {
+            return;
+        }
+        ranges[count++] = range;
+    }
+    rangeCount = count;
+}
 
-    socket.ignore(bodySize);
-    std::clog << "  Request: " << method << " " << URI << " " << version << " Body: " << bodySize << "\n";
+std::string_view HttpRequest::storeLine(std::string_view line)
+{
+    // Copy the line into raw and return a view of the copy.
+    if (std::size(line) > maxHeaderSize - rawSize) {
+        status.errorCode = 431;
+        status.errorMessage = "Request Header Fields Too Large";
+        status.humanInformation = Message{} << "Request header larger than " << maxHeaderSize << " bytes";
+        NISSE_LOG(Warning, "  Bad Request: Header too large");
+        return {};
+    }
+    char* dst = &raw[0] + rawSize;
+    std::copy(std::begin(line), std::end(line), dst);
+    rawSize += std::size(line);
+    return {dst, std::size(line)};
 }
 
-std::tuple<std::string, std::string, std::string> HttpRequest::splitFirstLine(std::string_view firstLine)
+std::tuple<std::string_view, std::string_view, std::string_view> HttpRequest::splitFirstLine(std::string_view firstLine, LineInfo const& info)
 {
-    auto sep1  = firstLine.find(' ');
+    // "info" holds the positions relative to the start of the line (so they also apply to the copy in raw).
+    auto sep1  = info.space1;
     auto begin = std::begin(firstLine);
-    if (sep1 == std::string_view::npos) {
+    if (sep1 == LineInfo::npos) {
         return {"", "", ""};
     }
-    auto sep2 = firstLine.find(' ', sep1 + 1);
-    if (sep2 == std::string_view::npos) {
+    auto sep2 = info.space2;
+    if (sep2 == LineInfo::npos) {
         return {{begin, begin + sep1}, "", ""};
     }
 
@@ -127,21 +357,25 @@ std::tuple<std::string, std::string, std::string> HttpRequest::splitFirstLine(st
     auto verBegin    = uriEnd + 1;
     auto verEnd      = std::max(verBegin, std::end(firstLine) - 2);
 
-    return  {{methodBegin, methodEnd}, {uriBegin, uriEnd}, {verBegin, verEnd}};
+    return  {{methodBegin, methodEnd}, {uriBegin, std::max(uriBegin, uriEnd)}, {verBegin, verEnd}};
 }
 
-std::tuple<std::string, std::string> HttpRequest::splitHeader(std::string_view header)
+std::tuple<std::string_view, std::string_view> HttpRequest::splitHeader(std::string_view header, LineInfo const& info)
 {
-    auto sep = header.find(':');
-    if (sep == std::string_view::npos) {
+    auto sep = info.colon;
+    if (sep == LineInfo::npos) {
         status.errorCode = 400;
         status.errorMessage = "Bad Request";
         status.humanInformation = Message{} << "HTTP message header badly formatted '" << header << "'";
-        std::clog << "  Bad Header: " << header << "\n";
-        return {std::string{header}, ""};
+        NISSE_LOG(Warning, "  Bad Header: ", header);
+        return {header, ""};
     }
-    std::string     name{std::begin(header), std::begin(header) + sep};
-    std::string     value{std::begin(header) + sep + 1, std::end(header)};
+    // Remove the optional white space around the value (and the trailing "\r\n").
+    std::string_view    name    = header.substr(0, sep);
+    std::string_view    value   = header.substr(sep + 1);
+    std::size_t         first   = value.find_first_not_of(" \t");
+    std::size_t         last    = value.find_last_not_of(" \t\r\n");
+    value = (first == std::string_view::npos) ? std::string_view{} : value.substr(first, last - first + 1);
 
     return {name, value};
 }
@@ -153,42 +387,115 @@ HttpResponse::HttpResponse(HttpRequest const& request)
     , status{request.getStatus()}
 {}
 
-void HttpResponse::send(Stream& socket, std::filesystem::path const& contentDir)
+bool HttpResponse::notModified(std::string_view etag, FileInfo const& file) const
 {
-    std::filesystem::path   filePath    = getFilePath(contentDir);
-
-    if (status.errorCode != 200)
-    {
-        socket.sendMessage(Message{} << "HTTP/1.1 " << status.errorCode << " " << status.errorMessage << "\r\n");
-        socket.sendMessage(Message{} << "message: " << status.humanInformation << "\r\n");
-        socket.sendMessage("content-length: 0\r\n");
-        socket.sendMessage("\r\n");
-        socket.sync();
-        std::clog << "  Send: " << status.errorCode << " " << status.errorMessage << "\n";
-        return;
+    // If-None-Match takes precedence. It uses the weak comparison (W/ is ignored).
+    std::string_view    ifNoneMatch = request.getIfNoneMatch();
+    if (!ifNoneMatch.empty()) {
+        return matchEntityTag(ifNoneMatch, etag);
     }
+    std::time_t         since;
+    return parseHttpDate(request.getIfModifiedSince(), since) && file.mtime.tv_sec <= since;
+}
 
-    std::uintmax_t fileSize = std::filesystem::file_size(filePath);
-
-    socket.sendMessage("HTTP/1.1 200 OK\r\n");
-    socket.sendMessage(Message{} << "content-length: " << fileSize << "\r\n");
-    socket.sendMessage("\r\n");
+bool HttpResponse::rangeApplies(std::string_view etag, FileInfo const& file) const
+{
+    // If-Range: Only send the ranges if the file has not changed.
+    // Otherwise the client gets the whole file.
+    // This uses the strong comparison (so a weak tag never matches).
+    std::string_view    ifRange = request.getIfRange();
+    if (ifRange.empty()) {
+        return true;
+    }
+    if (ifRange.starts_with('"') || ifRange.starts_with("W/")) {
+        return ifRange == etag;
+    }
+    return ifRange == httpDate(file.mtime.tv_sec);
+}
 
-    std::ifstream   file(filePath);
+std::vector<HttpRequest::ByteRange> HttpResponse::resolveRanges(std::size_t fileSize) const
+{
+    // Resolve the ranges against the file size.
+    // Unsatisfiable ranges (starting past the end of the file) are dropped.
+    // Then ranges that overlap or touch are merged (RFC 7233 section 6.1: A client can ask for
+    // the same bytes many times over with overlapping ranges). So each byte is sent once.
+    std::vector<HttpRequest::ByteRange> ranges;
+    for (HttpRequest::ByteRange range: request.getRanges())
+    {
+        if (range.first == std::string_view::npos)
+        {
+            if (range.last == 0) {
+                continue;
+            }
+            range.first = fileSize > range.last ? fileSize - range.last : 0;
+            range.last  = fileSize - 1;
+        }
+        if (range.first >= fileSize) {
+            continue;
+        }
+        range.last = std::min(range.last, fileSize - 1);
+        ranges.emplace_back(range);
+    }
 
-    std::string line;
-    while (std::getline(file, line))
+    std::sort(std::begin(ranges), std::end(ranges), [](auto const& lhs, auto const& rhs){return lhs.first < rhs.first;});
+    std::size_t merged = 0;
+    for (std::size_t loop = 1; loop < std::size(ranges); ++loop)
     {
-        socket.sendMessage(line);
-        if (file) {
-            socket.sendMessage("\n");
+        if (ranges[loop].first <= ranges[merged].last + 1) {
+            ranges[merged].last = std::max(ranges[merged].last, ranges[loop].last);
+        }
+        else {
+            ranges[++merged] = ranges[loop];
         }
     }
-    std::clog << "  Send: 200 OK\n";
-    socket.sync();
+    ranges.resize(std::min(std::size(ranges), merged + 1));
+    return ranges;
+}
+
+void HttpResponse::fileOpenFailed(FileInfo const& file)
+{
+    status.errorCode = 404;
+    status.errorMessage = "Not Found";
+    status.humanInformation = Message{} << "Failed to open file for: " << request.getURI();
+    NISSE_LOG(Warning, "  Failed to open: ", file.path);
 }
 
-std::filesystem::path HttpResponse::getFilePath(std::filesystem::path const& contentDir)
+std::string HttpResponse::httpDate(std::time_t time)
+{
+    ::tm        parts;
+    ::gmtime_r(&time, &parts);
+    char        buffer[32];
+    std::size_t size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    return {buffer, size};
+}
+
+std::string HttpResponse::entityTag(FileInfo const& file, std::string_view suffix)
+{
+    char    buffer[128];
+    char*   end     = buffer + sizeof(buffer);
+    char*   next    = buffer;
+    *next++ = '"';
+    next    = std::to_chars(next, end, file.inode, 16).ptr;
+    *next++ = '-';
+    next    = std::to_chars(next, end, file.size, 16).ptr;
+    *next++ = '-';
+    next    = std::to_chars(next, end, file.mtime.tv_sec, 16).ptr;
+    *next++ = '.';
+    next    = std::to_chars(next, end, file.mtime.tv_nsec, 16).ptr;
+    next    = std::copy(std::begin(suffix), std::end(suffix), next);
+    *next++ = '"';
+    return {buffer, next};
+}
+
+std::string HttpResponse::validatorHeaders(std::string_view etag, FileInfo const& file, bool vary)
+{
+    // Any response for a file that has alternative encodings must tell caches that it varies.
+    return Message{} << "etag: " << etag << "\r\n"
+                     << "last-modified: " << httpDate(file.mtime.tv_sec) << "\r\n"
+                     << (vary ? "vary: accept-encoding\r\n" : "");
+}
+
+std::filesystem::path HttpResponse::getRequestPath()
 {
     if (status.errorCode != 200) {
         return {};
@@ -201,47 +508,31 @@ std::filesystem::path HttpResponse::getFilePath(std::filesystem::path const& con
         status.errorCode = 400;
         status.errorMessage = "Bad Request";
         status.humanInformation = Message{} << "Invalid Request Path: " << requestPath;
-        std::clog << "  Invalid request path: " << requestPath << "\n";
+        NISSE_LOG(Warning, "  Invalid request path: ", requestPath);
         return {};
     }
+    return requestPath;
+}
 
-    std::error_code ec;
-    std::filesystem::path   filePath = std::filesystem::canonical(std::filesystem::path{contentDir} /= requestPath, ec);
-    if (!ec && std::filesystem::is_directory(filePath)) {
-        filePath = std::filesystem::canonical(filePath /= "index.html", ec);
-    }
-    if (ec || !std::filesystem::is_regular_file(filePath)) {
+FileInfoPtr HttpResponse::getFile(ContentStore& contentStore, std::filesystem::path const& requestPath)
+{
+    // The ContentStore caches the result of resolving the path to a file.
+    FileInfoPtr fileInfo = contentStore.find(requestPath);
+    if (!fileInfo) {
         status.errorCode = 404;
         status.errorMessage = "Not Found";
-        status.humanInformation = Message{} << "No file found at: " << uriPath;
-        std::clog << "  Invalid file path: " << filePath << " for URI " << uriPath << "\n";
+        status.humanInformation = Message{} << "No file found at: " << requestPath;
+        NISSE_LOG(Warning, "  Invalid file path: ", requestPath, " for URI ", request.getURI());
         return {};
     }
 
-    std::clog << "  File: " << filePath << "\n";
-    return filePath;
+    NISSE_LOG(Debug, "  File: ", fileInfo->path);
+    return fileInfo;
 }
 
-void handleConnection(Stream& socket, std::filesystem::path const& contentDir)
+void handleConnection(Stream& socket, ContentStore& contentStore)
 {
-    // Note: The requester can send multiple requests on the same connection.
-    //       So while there is data to processes then loop over it.
-    while (socket.hasData())
-    {
-        std::clog << "  Parsing HTTP Request\n";
-        HttpRequest     request(socket);
-        HttpResponse    response(request);
-        response.send(socket, contentDir);
-
-        if (!response.isValid())
-        {
-            // If there was an issue with the request.
-            // Anything on the stream is suspect so close it down.
-            socket.close();
-            std::clog << "  Manualy closing connection\n";
-            // Note: This will break the loop.
-        }
-    }
-    std::clog << "  Request Complete\n";
+    // The virtual version (for any Stream).
+    handleConnection<Stream>(socket, contentStore);
 }
 
@@ -0,0 +1,197 @@
+#ifndef HTTP_STUFF_H
+#define HTTP_STUFF_H
+
+#include "Stream.h"
+#include "ContentStore.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <span>
+#include <tuple>
+#include <filesystem>
+#include <ctime>
+
+/*
+ * Class Declarations:
+ *
+ *      ErrorStatus:        Error state that is reported back on each request.
+ *      OpenFile:           The descriptor used to read a file's content. Uses the descriptor held
+ *                          by the ContentStore cache, or opens (and closes) its own if there is none.
+ *      HttpRequest:        An HTTP request object that has been read from a 'Stream'.
+ *      HttpResponse:       An HTTP response object that can be written to a 'Stream' in
+ *                          response to an HttpRequest.
+ *
+ * The members that read from or write to the stream are templates constrained by HttpStream
+ * (see Stream.h) and are defined in HTTPStuff.tpp. Used with a concrete (final) socket class
+ * every getNextLine(), sendMessage() and hasData() is a direct call the compiler can inline.
+ * Used with Stream they make the normal virtual calls. The non template
+ * handleConnection(Stream&, ContentStore&) is that version.
+ */
+
+struct ErrorStatus
+{
+    ErrorStatus()
+        : errorCode{200}
+        , errorMessage{"OK"}
+    {}
+
+    int             errorCode;
+    std::string     errorMessage;
+    std::string     humanInformation;
+};
+
+class OpenFile
+{
+    FileInfoPtr     info;
+    int             fd;
+    public:
+        OpenFile(FileInfoPtr info);
+        ~OpenFile();
+
+        OpenFile(OpenFile const&)               = delete;
+        OpenFile& operator=(OpenFile const&)    = delete;
+
+        bool        isOpen()    const   {return fd != -1;}
+        int         getFd()     const   {return fd;}
+        std::size_t size()      const   {return info->size;}
+};
+
+class HttpRequest
+{
+    public:
+        static constexpr std::size_t    maxHeaderSize   = 8 * 1024;
+        static constexpr std::size_t    maxHeaderCount  = 64;
+        struct Header
+        {
+            std::string_view    name;
+            std::string_view    value;
+        };
+        // Bit mask of the content codings the client accepts (identity is always acceptable).
+        enum Encoding {Identity = 0, Gzip = 1, Brotli = 2};
+        // A range from the Range header (inclusive).
+        // "500-"   is stored as {500, npos}
+        // "-500"   (the last 500 bytes) is stored as {npos, 500}
+        struct ByteRange
+        {
+            std::size_t         first;
+            std::size_t         last;
+        };
+        static constexpr std::size_t    maxRanges       = 16;
+    private:
+    ErrorStatus     status;
+
+    // The request line and headers are copied into "raw".
+    // All the std::string_view members below refer into this buffer.
+    // So a request does not allocate any memory while it is parsed.
+    std::array<char, maxHeaderSize>     raw;
+    std::size_t                         rawSize;
+
+    std::string_view                    method;
+    std::string_view                    URI;
+    std::string_view                    version;
+    std::array<Header, maxHeaderCount>  headers;
+    std::size_t                         headerCount;
+    int                                 acceptEncoding;
+    std::array<ByteRange, maxRanges>    ranges;
+    std::size_t                         rangeCount;
+    std::string_view                    ifRange;
+    std::string_view                    ifNoneMatch;
+    std::string_view                    ifModifiedSince;
+    std::size_t                         bodySize;
+    std::size_t                         bodyRemaining;
+
+    public:
+        template<HttpStream S>
+        HttpRequest(S& socket);
+
+        HttpRequest(HttpRequest const&)             = delete;
+        HttpRequest& operator=(HttpRequest const&)  = delete;
+
+        ErrorStatus const&  getStatus()         const   {return status;}
+        std::string_view    getMethod()         const   {return method;}
+        std::string_view    getURI()            const   {return URI;}
+        std::string_view    getVersion()        const   {return version;}
+        std::span<Header const> getHeaders()    const   {return {std::begin(headers), headerCount};}
+        // Header names are compared case insensitively.
+        // Returns an empty view if the header is not present.
+        std::string_view    getHeader(std::string_view name) const;
+        int                 getAcceptEncoding() const   {return acceptEncoding;}
+        std::span<ByteRange const> getRanges()  const   {return {std::begin(ranges), rangeCount};}
+        std::string_view    getIfRange()        const   {return ifRange;}
+        std::string_view    getIfNoneMatch()    const   {return ifNoneMatch;}
+        std::string_view    getIfModifiedSince() const  {return ifModifiedSince;}
+        bool                isConditional()     const   {return !ifNoneMatch.empty() || !ifModifiedSince.empty();}
+        bool isValid() const {return status.errorCode == 200;}
+
+        // The body is not read by the constructor. A handler can stream it with
+        // readBody() or spliceBody(). Whatever is left is skipped by discardBody()
+        // (handleConnection() calls it before reading the next request).
+        std::size_t         getBodySize()       const   {return bodySize;}
+        std::size_t         getBodyRemaining()  const   {return bodyRemaining;}
+        // Read the next part of the body (at most "size" bytes). Returns 0 at the end of the body.
+        template<HttpStream S>
+        std::size_t         readBody(S& socket, char* buffer, std::size_t size);
+        // Write the rest of the body to the open file "fileFd". Returns the number of bytes written.
+        template<HttpStream S>
+        std::size_t         spliceBody(S& socket, int fileFd);
+        template<HttpStream S>
+        void                discardBody(S& socket);
+
+    private:
+        bool                                                        setFirstLine(std::string_view line, LineInfo const& info);
+        void                                                        addHeader(std::string_view line, LineInfo const& info);
+        std::size_t                                                 finishHeaders();
+        static int                                                  parseAcceptEncoding(std::string_view value);
+        void                                                        parseRange(std::string_view value);
+        std::string_view                                            storeLine(std::string_view line);
+        std::tuple<std::string_view, std::string_view>              splitHeader(std::string_view header, LineInfo const& info);
+        std::tuple<std::string_view, std::string_view, std::string_view>   splitFirstLine(std::string_view firstLine, LineInfo const& info);
+};
+
+class HttpResponse
+{
+    HttpRequest const&  request;
+    ErrorStatus         status;
+
+    public:
+        HttpResponse(HttpRequest const& request);
+
+        bool isValid() const {return status.errorCode == 200;}
+        template<HttpStream S>
+        void send(S& socket, ContentStore& contentStore);
+    private:
+        template<HttpStream S>
+        bool                    sendCached(S& socket, ResponseCache& responseCache, std::string const& cacheKey);
+        template<HttpStream S>
+        void                    sendRanges(S& socket, FileInfoPtr const& fileInfo, std::string const& validators);
+        template<HttpStream S>
+        void                    sendError(S& socket);
+
+        bool                    notModified(std::string_view etag, FileInfo const& file) const;
+        bool                    rangeApplies(std::string_view etag, FileInfo const& file) const;
+        std::vector<HttpRequest::ByteRange> resolveRanges(std::size_t fileSize) const;
+        std::filesystem::path   getRequestPath();
+        FileInfoPtr             getFile(ContentStore& contentStore, std::filesystem::path const& requestPath);
+        void                    fileOpenFailed(FileInfo const& file);
+
+        // Format a time as an HTTP date (IMF-fixdate): "Sun, 06 Nov 1994 08:49:37 GMT"
+        static std::string      httpDate(std::time_t time);
+        // Strong entity tag built from the inode, size and modification time.
+        // Any change to (or replacement of) the file gives a new tag.
+        static std::string      entityTag(FileInfo const& file, std::string_view suffix = {});
+        static std::string      validatorHeaders(std::string_view etag, FileInfo const& file, bool vary);
+};
+
+// Handle one request on a connection.
+// Returns false if the request was bad (the connection has been closed).
+template<HttpStream S>
+bool handleRequest(S& socket, ContentStore& contentStore);
+// Handle all the requests on a connection.
+template<HttpStream S>
+void handleConnection(S& socket, ContentStore& contentStore);
+
+#include "HTTPStuff.tpp"
+
+#endif
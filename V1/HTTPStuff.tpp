@@ -0,0 +1,356 @@
+/*
+ * Definitions of the HTTPStuff.h templates.
+ * Included from HTTPStuff.h: Do not include directly.
+ */
+
+#include "Logger.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+// HttpRequest
+// ===========
+template<HttpStream S>
+HttpRequest::HttpRequest(S& socket)
+    : rawSize{0}
+    , headerCount{0}
+    , acceptEncoding{Identity}
+    , rangeCount{0}
+    , bodySize{0}
+    , bodyRemaining{0}
+{
+    using std::literals::operator""sv;
+
+    // The stream found the separators while it looked for the end of each line.
+    std::string_view firstLine = socket.getNextLine();
+    if (!setFirstLine(firstLine, socket.getLineInfo(firstLine))) {
+        return;
+    }
+
+    std::string_view header;
+    while (status.errorCode == 200 && (header = socket.getNextLine()) != "\r\n"sv)
+    {
+        addHeader(header, socket.getLineInfo(header));
+    }
+    if (status.errorCode != 200) {
+        return;
+    }
+
+    bodySize        = finishHeaders();
+    bodyRemaining   = bodySize;
+}
+
+template<HttpStream S>
+std::size_t HttpRequest::readBody(S& socket, char* buffer, std::size_t size)
+{
+    if (bodyRemaining == 0 || size == 0) {
+        return 0;
+    }
+    std::size_t amountRead = socket.readBody(buffer, std::min(size, bodyRemaining));
+    bodyRemaining -= amountRead;
+    return amountRead;
+}
+
+template<HttpStream S>
+std::size_t HttpRequest::spliceBody(S& socket, int fileFd)
+{
+    std::size_t written = socket.spliceTo(fileFd, bodyRemaining);
+    bodyRemaining -= written;
+    return written;
+}
+
+template<HttpStream S>
+void HttpRequest::discardBody(S& socket)
+{
+    socket.ignore(bodyRemaining);
+    bodyRemaining = 0;
+}
+
+// HttpResponse
+// ============
+template<HttpStream S>
+void HttpResponse::send(S& socket, ContentStore& contentStore)
+{
+    std::filesystem::path   requestPath = getRequestPath();
+    if (status.errorCode != 200) {
+        sendError(socket);
+        return;
+    }
+
+    // Small files are kept in the cache as a complete response.
+    // So a hit is a single write with no file system access.
+    // The accepted encodings are part of the key as they select which body is sent.
+    // Range requests are not cached (each one can ask for different bytes) and conditional
+    // requests must be checked against the file before a cached response can be used.
+    int const               encodings       = request.getAcceptEncoding();
+    bool const              ranged          = !request.getRanges().empty();
+    ResponseCache&          responseCache   = contentStore.getResponseCache();
+    // Read before the file is looked at (see ResponseCache::insert()).
+    std::uint64_t const     generation      = responseCache.generation();
+    std::string             cacheKey        = requestPath.string();
+    cacheKey += '\0';
+    cacheKey += static_cast<char>('0' + encodings);
+    if (!ranged && !request.isConditional() && sendCached(socket, responseCache, cacheKey)) {
+        return;
+    }
+
+    FileInfoPtr             fileInfo    = getFile(contentStore, requestPath);
+    if (status.errorCode != 200)
+    {
+        sendError(socket);
+        return;
+    }
+
+    // Pick the smallest body the client accepts:
+    //      A pre-compressed file (brotli then gzip) that sits beside the original.
+    //      A gzip version compressed on demand (and cached) by the ContentStore.
+    //      The original file.
+    // Ranges are always served from the original (identity encoded) file.
+    // Note: The on demand version is not built until we know it will be sent.
+    int const               accepted    = ranged ? HttpRequest::Identity : encodings;
+    FileInfoPtr             body        = fileInfo;
+    std::string_view        encoding;
+    bool                    onDemand    = false;
+    if ((accepted & HttpRequest::Brotli) && fileInfo->brotli) {
+        body        = fileInfo->brotli;
+        encoding    = "br";
+    }
+    else if ((accepted & HttpRequest::Gzip) && fileInfo->gzip) {
+        body        = fileInfo->gzip;
+        encoding    = "gzip";
+    }
+    else if ((accepted & HttpRequest::Gzip) && contentStore.compressible(*fileInfo)) {
+        encoding    = "gzip";
+        onDemand    = true;
+    }
+
+    // Any response for a file that has alternative encodings must tell caches that it varies.
+    // Each encoding is a different representation so it has its own entity tag.
+    bool                    vary        = fileInfo->gzip || fileInfo->brotli || contentStore.compressible(*fileInfo);
+    std::string             etag        = entityTag(*body, onDemand ? "-gzip" : "");
+    std::string             validators  = validatorHeaders(etag, *fileInfo, vary);
+
+    // Conditional requests are answered from the cached FileInfo.
+    // So a 304 never opens (or reads) the file.
+    if (request.isConditional())
+    {
+        if (notModified(etag, *fileInfo))
+        {
+            socket.sendMessage(Message{} << "HTTP/1.1 304 Not Modified\r\n" << validators << "\r\n");
+            socket.sync();
+            NISSE_LOG(Info, "  Send: 304 Not Modified");
+            return;
+        }
+        if (!ranged && sendCached(socket, responseCache, cacheKey)) {
+            return;
+        }
+    }
+
+    if (ranged && rangeApplies(etag, *fileInfo))
+    {
+        sendRanges(socket, fileInfo, validators);
+        return;
+    }
+
+    // The response is only cached under "cacheKey" if its body is the one the accepted encodings
+    // select. A ranged request that falls through (If-Range did not match) only accepted identity
+    // and a failed compression falls back to the original file.
+    bool                    keyedBody   = !ranged;
+    ResponseCache::Response compressed  = onDemand ? contentStore.compress(*fileInfo) : nullptr;
+    if (onDemand && !compressed)
+    {
+        // Failed to compress: Fall back to the original file.
+        keyedBody   = false;
+        encoding    = "";
+        etag        = entityTag(*body);
+        validators  = validatorHeaders(etag, *fileInfo, vary);
+    }
+
+    OpenFile                file(compressed ? nullptr : body);
+    if (!compressed && !file.isOpen())
+    {
+        fileOpenFailed(*body);
+        sendError(socket);
+        return;
+    }
+
+    std::size_t bodySize = compressed ? std::size(*compressed) : file.size();
+    Message     header;
+    header << "HTTP/1.1 200 OK\r\n"
+           << "content-length: " << bodySize << "\r\n";
+    if (!encoding.empty()) {
+        header << "content-encoding: " << encoding << "\r\n";
+    }
+    header << validators
+           << "\r\n";
+
+    if (keyedBody && responseCache.cacheable(bodySize))
+    {
+        // Build the complete response in one buffer and keep it for the next request.
+        std::string response{header.view()};
+        std::size_t bodyStart = std::size(response);
+        if (compressed) {
+            response += *compressed;
+        }
+        else {
+            response.resize(bodyStart + bodySize);
+            readFile(file.getFd(), &response[bodyStart], bodySize, 0);
+        }
+
+        ResponseCache::Response fullResponse = std::make_shared<std::string const>(std::move(response));
+        responseCache.insert(cacheKey, fileInfo->path, fullResponse, fileInfo->watched, generation);
+        socket.sendReference(*fullResponse);
+        socket.sync();
+        NISSE_LOG(Info, "  Send: 200 OK ", encoding);
+        return;
+    }
+
+    socket.sendMessage(header);
+    if (compressed) {
+        // "compressed" is held by the compressed cache only until it is evicted.
+        // So sync() before it goes out of scope.
+        socket.sendReference(*compressed);
+    }
+    else {
+        // The body is sent as a raw byte range of the file.
+        // This lets the stream decide the most efficient way to move the data.
+        socket.sendFileRange(file.getFd(), 0, bodySize);
+    }
+    NISSE_LOG(Info, "  Send: 200 OK ", encoding);
+    socket.sync();
+}
+
+template<HttpStream S>
+bool HttpResponse::sendCached(S& socket, ResponseCache& responseCache, std::string const& cacheKey)
+{
+    ResponseCache::Response cached = responseCache.find(cacheKey);
+    if (!cached) {
+        return false;
+    }
+    socket.sendReference(*cached);
+    socket.sync();
+    NISSE_LOG(Info, "  Send: 200 OK (cached)");
+    return true;
+}
+
+template<HttpStream S>
+void HttpResponse::sendRanges(S& socket, FileInfoPtr const& fileInfo, std::string const& validators)
+{
+    std::size_t const                   fileSize    = fileInfo->size;
+    std::vector<HttpRequest::ByteRange> ranges      = resolveRanges(fileSize);
+    if (ranges.empty())
+    {
+        // The request itself was fine so the connection is kept open.
+        socket.sendMessage(Message{} << "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                                     << "content-range: bytes */" << fileSize << "\r\n"
+                                     << "content-length: 0\r\n"
+                                     << validators
+                                     << "\r\n");
+        socket.sync();
+        NISSE_LOG(Info, "  Send: 416 Range Not Satisfiable");
+        return;
+    }
+
+    OpenFile    file(fileInfo);
+    if (!file.isOpen())
+    {
+        fileOpenFailed(*fileInfo);
+        sendError(socket);
+        return;
+    }
+
+    // Each range is sent straight from the file at its offset.
+    // So nothing before the range is read.
+    if (std::size(ranges) == 1)
+    {
+        HttpRequest::ByteRange const&   range = ranges[0];
+        std::size_t                     size  = range.last - range.first + 1;
+        socket.sendMessage(Message{} << "HTTP/1.1 206 Partial Content\r\n"
+                                     << "content-length: " << size << "\r\n"
+                                     << "content-range: bytes " << range.first << "-" << range.last << "/" << fileSize << "\r\n"
+                                     << validators
+                                     << "\r\n");
+        socket.sendFileRange(file.getFd(), range.first, size);
+        socket.sync();
+        NISSE_LOG(Info, "  Send: 206 Partial Content");
+        return;
+    }
+
+    // Multiple ranges: A multipart/byteranges body with a part per range.
+    // The part headers are built first as we need the total length up front.
+    static std::atomic<std::size_t> boundaryCount{0};
+    std::string                     boundary    = Message{} << "NisseByteRange" << ++boundaryCount;
+    std::vector<std::string>        partHeaders;
+    std::string                     closing     = Message{} << "\r\n--" << boundary << "--\r\n";
+    std::size_t                     bodySize    = std::size(closing);
+    for (HttpRequest::ByteRange const& range: ranges)
+    {
+        partHeaders.emplace_back(Message{} << "\r\n--" << boundary << "\r\n"
+                                           << "content-range: bytes " << range.first << "-" << range.last << "/" << fileSize << "\r\n"
+                                           << "\r\n");
+        bodySize += std::size(partHeaders.back()) + (range.last - range.first + 1);
+    }
+
+    socket.sendMessage(Message{} << "HTTP/1.1 206 Partial Content\r\n"
+                                 << "content-type: multipart/byteranges; boundary=" << boundary << "\r\n"
+                                 << "content-length: " << bodySize << "\r\n"
+                                 << validators
+                                 << "\r\n");
+    for (std::size_t loop = 0; loop < std::size(ranges); ++loop)
+    {
+        socket.sendMessage(partHeaders[loop]);
+        socket.sendFileRange(file.getFd(), ranges[loop].first, ranges[loop].last - ranges[loop].first + 1);
+    }
+    socket.sendMessage(closing);
+    socket.sync();
+    NISSE_LOG(Info, "  Send: 206 Partial Content (", std::size(ranges), " ranges)");
+}
+
+template<HttpStream S>
+void HttpResponse::sendError(S& socket)
+{
+    socket.sendMessage(Message{} << "HTTP/1.1 " << status.errorCode << " " << status.errorMessage << "\r\n");
+    socket.sendMessage(Message{} << "message: " << status.humanInformation << "\r\n");
+    socket.sendReference("content-length: 0\r\n");
+    socket.sendReference("\r\n");
+    socket.sync();
+    NISSE_LOG(Info, "  Send: ", status.errorCode, " ", status.errorMessage);
+}
+
+// handleConnection
+// ================
+template<HttpStream S>
+bool handleRequest(S& socket, ContentStore& contentStore)
+{
+    NISSE_LOG(Debug, "  Parsing HTTP Request");
+    HttpRequest     request(socket);
+    socket.headersComplete();
+    HttpResponse    response(request);
+    response.send(socket, contentStore);
+
+    if (!response.isValid())
+    {
+        // If there was an issue with the request.
+        // Anything on the stream is suspect so close it down.
+        socket.close();
+        NISSE_LOG(Debug, "  Manualy closing connection");
+        return false;
+    }
+    // Skip any of the body that was not used so the next request can be read.
+    request.discardBody(socket);
+    socket.requestComplete();
+    return true;
+}
+
+template<HttpStream S>
+void handleConnection(S& socket, ContentStore& contentStore)
+{
+    // Note: The requester can send multiple requests on the same connection.
+    //       So while there is data to processes then loop over it.
+    while (socket.hasData() && handleRequest(socket, contentStore))
+    {}
+    NISSE_LOG(Debug, "  Request Complete");
+}
@@ -0,0 +1,176 @@
+#include "Logger.h"
+
+#include <iostream>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// LogRing
+// =======
+LogRing::LogRing()
+    : head{0}
+    , tail{0}
+    , dropped{0}
+    , abandoned{false}
+{}
+
+void LogRing::push(std::string_view record)
+{
+    std::size_t const   next = head.load(std::memory_order_relaxed);
+    if (next - tail.load(std::memory_order_acquire) == slotCount) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Slot&       slot = slots[next & (slotCount - 1)];
+    std::size_t size = std::min(std::size(record), sizeof(slot.text));
+    std::copy(std::begin(record), std::begin(record) + size, slot.text);
+    if (size != std::size(record)) {
+        // Truncated: Keep the line ending.
+        slot.text[size - 1] = '\n';
+    }
+    slot.size = size;
+    head.store(next + 1, std::memory_order_release);
+}
+
+bool LogRing::drain(std::string& output)
+{
+    // Read "abandoned" first: If it is set there are no more records coming after this drain.
+    bool const          finished    = abandoned.load(std::memory_order_acquire);
+    std::size_t const   end         = head.load(std::memory_order_acquire);
+    std::size_t         next        = tail.load(std::memory_order_relaxed);
+
+    for (; next != end; ++next)
+    {
+        Slot const& slot = slots[next & (slotCount - 1)];
+        output.append(slot.text, slot.size);
+    }
+    tail.store(next, std::memory_order_release);
+
+    std::size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost != 0) {
+        output += Message{} << "Log: " << lost << " records dropped\n";
+    }
+    return finished;
+}
+
+// Logger
+// ======
+Logger& Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : outputFd{STDERR_FILENO}
+    , finished{false}
+{
+    drainer = std::thread(&Logger::drainRings, this);
+}
+
+Logger::~Logger()
+{
+    {
+        std::unique_lock    lock(drainMutex);
+        finished = true;
+    }
+    drainCondition.notify_one();
+    drainer.join();
+
+    if (outputFd != STDERR_FILENO) {
+        ::close(outputFd);
+    }
+}
+
+void Logger::setOutput(std::filesystem::path const& path)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        std::cerr << "Failed to open log file: " << path << " " << errno << " " << strerror(errno) << "\n";
+        return;
+    }
+    // Anything already buffered is written to the new file.
+    // Swapped under the drain lock: So the background thread is not part way through a write
+    // to the old descriptor when it is closed (and its number possibly reused).
+    std::unique_lock    lock(drainMutex);
+    int old = std::exchange(outputFd, fd);
+    if (old != STDERR_FILENO) {
+        ::close(old);
+    }
+}
+
+LogRing& Logger::threadRing()
+{
+    // Each thread gets its own ring the first time it logs.
+    // The ring is shared with the Logger so records still waiting when the
+    // thread exits are written before the ring is released.
+    struct ThreadRing
+    {
+        std::shared_ptr<LogRing>    ring;
+        ThreadRing(Logger& logger)
+            : ring{std::make_shared<LogRing>()}
+        {
+            std::unique_lock    lock(logger.ringMutex);
+            logger.rings.emplace_back(ring);
+        }
+        ~ThreadRing()
+        {
+            ring->abandon();
+        }
+    };
+    thread_local ThreadRing threadRing(*this);
+    return *threadRing.ring;
+}
+
+void Logger::drainRings()
+{
+    std::string batch;
+    batch.reserve(batchSize);
+
+    std::unique_lock    lock(drainMutex);
+    while (!finished)
+    {
+        drainCondition.wait_for(lock, flushInterval, [&](){return finished;});
+        drainAll(batch);
+    }
+}
+
+void Logger::drainAll(std::string& batch)
+{
+    std::unique_lock    lock(ringMutex);
+    for (auto loop = std::begin(rings); loop != std::end(rings);)
+    {
+        bool released = (*loop)->drain(batch);
+        loop = released ? rings.erase(loop) : std::next(loop);
+        if (std::size(batch) >= batchSize) {
+            write(batch);
+        }
+    }
+    write(batch);
+}
+
+void Logger::write(std::string& batch)
+{
+    // Called with drainMutex held.
+    int         fd      = outputFd;
+    char const* data    = std::data(batch);
+    std::size_t size    = std::size(batch);
+    while (size != 0)
+    {
+        ::ssize_t writeStatus = ::write(fd, data, size);
+        if (writeStatus == -1 && errno == EINTR) {
+            continue;
+        }
+        if (writeStatus == -1) {
+            // Nowhere to report the error. Drop the batch.
+            break;
+        }
+        data += writeStatus;
+        size -= writeStatus;
+    }
+    batch.clear();
+}
@@ -0,0 +1,134 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+/*
+ * Logger:  Asynchronous logging for the request path.
+ *
+ * Use the NISSE_LOG() macro:
+ *
+ *      NISSE_LOG(Info, "  Request: ", method, " ", URI);
+ *
+ * The level is checked at compile time against NISSE_LOG_LEVEL (set it with -DNISSE_LOG_LEVEL=<n>
+ * in CPPFLAGS). A disabled level is removed by the compiler so its arguments are never evaluated.
+ *
+ * An enabled record is formatted (with Message) and copied into a ring buffer owned by the
+ * calling thread. The ring has a single producer (the thread) and a single consumer (the
+ * background thread) so pushing a record is lock free and never makes a system call.
+ * The background thread wakes every "flushInterval" and writes everything in all the rings
+ * to the output in one batch. If a ring is full the record is dropped (the logger never blocks
+ * a request) and the number dropped is reported in the output.
+ *
+ * Records from one thread are written in order. Records from different threads may interleave
+ * differently from the real time order within one flush interval.
+ *
+ * Class Declarations:
+ *
+ *      LogRing:    Single producer single consumer ring of fixed size records.
+ *      Logger:     Owns the background thread and the list of rings (one per thread that logs).
+ */
+
+#include "Stream.h"
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+enum class LogLevel {Error = 0, Warning = 1, Info = 2, Debug = 3};
+
+#ifndef NISSE_LOG_LEVEL
+#define NISSE_LOG_LEVEL     2
+#endif
+
+#define NISSE_LOG(level, ...)                                                               \
+    do {                                                                                    \
+        if constexpr (static_cast<int>(LogLevel::level) <= NISSE_LOG_LEVEL) {               \
+            Logger::instance().log(__VA_ARGS__);                                            \
+        }                                                                                   \
+    } while (false)
+
+class LogRing
+{
+    public:
+        static constexpr std::size_t    slotCount   = 1024;    // Must be a power of 2.
+        static constexpr std::size_t    slotSize    = 256;     // Longer records are truncated.
+
+    private:
+        struct Slot
+        {
+            std::uint32_t   size;
+            char            text[slotSize - sizeof(std::uint32_t)];
+        };
+
+        std::array<Slot, slotCount>             slots;
+        alignas(64) std::atomic<std::size_t>    head;       // Next slot written (by the producer).
+        alignas(64) std::atomic<std::size_t>    tail;       // Next slot read (by the consumer).
+        std::atomic<std::size_t>                dropped;
+        std::atomic<bool>                       abandoned;  // The producer thread has exited.
+
+    public:
+        LogRing();
+
+        // Producer.
+        void        push(std::string_view record);
+        void        abandon()                   {abandoned.store(true, std::memory_order_release);}
+
+        // Consumer: Append all available records to "output".
+        // Returns true if the ring is empty and can be released.
+        bool        drain(std::string& output);
+};
+
+class Logger
+{
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::chrono::milliseconds  flushInterval{10};
+    static constexpr std::size_t                batchSize = 64 * 1024;
+
+    std::mutex                              ringMutex;
+    std::vector<std::shared_ptr<LogRing>>   rings;
+
+    // Held by the background thread while it drains and writes (released while it waits).
+    std::mutex                              drainMutex;
+    int                                     outputFd;       // Guarded by "drainMutex".
+    std::condition_variable                 drainCondition;
+    bool                                    finished;
+    std::thread                             drainer;
+
+    public:
+        static Logger& instance();
+
+        Logger(Logger const&)               = delete;
+        Logger& operator=(Logger const&)    = delete;
+
+        // Send the log to a file (appended) rather than stderr.
+        void setOutput(std::filesystem::path const& path);
+
+        template<typename... Args>
+        void log(Args const&... args)
+        {
+            Message message;
+            (message << ... << args);
+            message << '\n';
+            threadRing().push(message);
+        }
+
+    private:
+        Logger();
+        ~Logger();
+
+        LogRing&    threadRing();
+        void        drainRings();
+        void        drainAll(std::string& batch);
+        void        write(std::string& batch);
+};
+
+#endif
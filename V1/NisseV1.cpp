@@ -1,86 +1,85 @@
 #include "Stream.h"
+#include "Socket.h"
+#include "ContentStore.h"
+#include "HTTPStuff.h"
+#include "Logger.h"
+#ifdef __linux__
+#include "Uring.h"
+#endif
 
 #include <iostream>
 #include <string>
 #include <string_view>
 #include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <memory>
 #include <exception>
+#include <cstring>
 
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 /*
  * Class Declarations:
  *
- *      Socket:             A Unix socket connection that has been established.
- *                          It acts like a bi-directional communication channel.
- *                          It has an internal buffer to track requests.
+ *      Socket:             See Socket.h
+ *      ListenConfig:       How the listening sockets are set up.
  *      Server:             A Unix socket listening for incoming connections.
+ *                          Linux: With ListenConfig::uring each listener has its own Uring (see Uring.h).
+ *                          It accepts with a multishot accept and its connections read and write through it.
  *      WebServer:          A class to represent and manage incoming connections.
+ *                          With a "statsInterval" a thread logs the cache statistics (hits, misses,
+ *                          evictions and size) at that interval.
+ *                          With more than one listener each listener has its own SO_REUSEPORT socket
+ *                          and its own thread. So the kernel spreads new connections across the threads.
  */
 
-class Socket: public Stream
+struct ListenConfig
 {
-    static constexpr std::size_t    inputBufferGrowth = 500;
-    static constexpr std::size_t    outputBufferMax   = 1000;
-    int                 fd;
-    std::vector<char>   buffer;
-    std::vector<char>   outputBuffer;
-    std::string_view    currentLine;
-    bool                readAvail;
-    bool                writeAvail;
-    public:
-        Socket(int fd);
-        ~Socket();
-
-        Socket(Socket&& move)               noexcept;
-        Socket& operator=(Socket&& move)    noexcept;
-        void swap(Socket& other)            noexcept;
-
-        friend void swap(Socket& lhs, Socket& rhs)  {lhs.swap(rhs);}
-
-        Socket(Socket const&)               = delete;
-        Socket& operator=(Socket const&)    = delete;
-
-        std::string_view    getNextLine()   override;
-        void ignore(std::size_t size)       override;
-
-        void sendMessage(std::string const& message)    override;
-        void sync()                                     override;
-
-        bool isOpen()   const {return fd != 0;}
-        bool hasData()  const   override {return !buffer.empty() || readAvail;}
-        void close()            override;
-    private:
-        void removeCurrentLine();
-        bool checkLineInBuffer();
-        void readMoreData(std::size_t maxSize, bool required = false);
-        void sendData(char const* buffer, std::size_t size);
+    int             backlog         = SOMAXCONN;
+    std::size_t     listeners       = 1;        // More than one uses SO_REUSEPORT.
+    bool            deferAccept     = false;    // Linux: accept() only returns once request data has arrived.
+    int             deferSeconds    = 5;        // How long the kernel holds a connection with no data.
+    bool            uring           = false;    // Linux: Accept, read and write through io_uring.
 };
 
 class Server
 {
-    static constexpr int backlog = 5;
     int fd;
+#ifdef __linux__
+    std::unique_ptr<Uring>  ring;
+#endif
     public:
-        Server(int port);
+        Server(int port, ListenConfig const& config);
         ~Server();
 
+        Server(Server const&)               = delete;
+        Server& operator=(Server const&)    = delete;
+
         Socket accept();
 };
 
 class WebServer
 {
-    Server                          connection;
+    std::deque<Server>              connections;
     bool                            finished;
-    std::filesystem::path const&    contentDir;
+    ContentStore                    contentStore;
+    std::chrono::seconds            statsInterval;
     public:
-        WebServer(int port, std::filesystem::path const& contentDir);
+        WebServer(int port, std::filesystem::path const& contentDir, ListenConfig const& config = ListenConfig{}, ContentConfig const& contentConfig = ContentConfig{}, std::chrono::seconds statsInterval = std::chrono::seconds{0});
 
         void run();
+    private:
+        void acceptConnections(Server& connection);
+        void logStats();
 };
 
 // The application body.
@@ -88,9 +87,62 @@ class WebServer
 
 int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    // Options:
+    //      -b <backlog>    The listen() backlog.
+    //      -d <seconds>    Linux: accept() only returns once the client has sent data (TCP_DEFER_ACCEPT).
+    //                      The kernel drops a connection with no data after <seconds>.
+    //      -u              Linux: Accept, read and write through io_uring.
+    //      -z              Gzip text files (for clients that accept it) that have no ".gz" beside them.
+    //      -c <bytes>      The response cache size (0: No response cache).
+    //      -f <bytes>      The largest file held in the response cache.
+    //      -s <seconds>    Log the cache statistics every <seconds>.
+    //      -l <logFile>    Append the log to <logFile> (rather than stderr).
+    ListenConfig            config;
+    ContentConfig           contentConfig;
+    std::chrono::seconds    statsInterval{0};
+    while (argc >= 2)
     {
-        std::cerr << "Usage: NisseV1 <port> <documentPath>" << "\n";
+        std::string_view    option = argv[1];
+        if (option == "-u") {
+            config.uring                    = true;
+        }
+        else if (option == "-z") {
+            contentConfig.compressOnDemand  = true;
+        }
+        else if (argc < 3) {
+            break;
+        }
+        else if (option == "-b") {
+            config.backlog                  = std::stoi(argv[2]);
+        }
+        else if (option == "-d") {
+            config.deferAccept              = true;
+            config.deferSeconds             = std::stoi(argv[2]);
+        }
+        else if (option == "-c") {
+            contentConfig.responseCacheBytes= std::stoul(argv[2]);
+        }
+        else if (option == "-f") {
+            contentConfig.responseCacheFile = std::stoul(argv[2]);
+        }
+        else if (option == "-s") {
+            statsInterval                   = std::chrono::seconds{std::stoi(argv[2])};
+        }
+        else if (option == "-l") {
+            Logger::instance().setOutput(argv[2]);
+        }
+        else {
+            break;
+        }
+        // The options with a value use two arguments.
+        std::size_t const   used = (option == "-u" || option == "-z") ? 1 : 2;
+        argc -= used;
+        argv += used;
+    }
+
+    if (argc != 3 && argc != 4)
+    {
+        std::cerr << "Usage: NisseV1 [-u] [-z] [-b <backlog>] [-d <deferSeconds>] [-c <cacheBytes>] [-f <cacheFileBytes>] [-s <statsSeconds>] [-l <logFile>] <port> <documentPath> [<listeners>]" << "\n";
         return 1;
     }
 
@@ -99,8 +151,12 @@ int main(int argc, char* argv[])
         static const int port = std::stoi(argv[1]);
         static const std::filesystem::path  contentDir  = std::filesystem::canonical(argv[2]);
 
+        if (argc == 4) {
+            config.listeners = std::stoul(argv[3]);
+        }
+
         std::cout << "Nisse Proto 1\n";
-        WebServer   server(port, contentDir);
+        WebServer   server(port, contentDir, config, contentConfig, statsInterval);
         server.run();
     }
     catch(std::exception const& e)
@@ -121,31 +177,76 @@ int main(int argc, char* argv[])
 
 // WebServer
 // =========
-WebServer::WebServer(int port, std::filesystem::path const& contentDir)
-    : connection{port}
-    , finished{false}
-    , contentDir{contentDir}
-{}
+WebServer::WebServer(int port, std::filesystem::path const& contentDir, ListenConfig const& config, ContentConfig const& contentConfig, std::chrono::seconds statsInterval)
+    : finished{false}
+    , contentStore{contentDir, contentConfig}
+    , statsInterval{statsInterval}
+{
+    for (std::size_t loop = 0; loop < std::max<std::size_t>(1, config.listeners); ++loop) {
+        connections.emplace_back(port, config);
+    }
+}
 
 void WebServer::run()
+{
+    // The first listener uses this thread. Any others get their own thread.
+    std::vector<std::thread>    threads;
+    for (auto loop = std::next(std::begin(connections)); loop != std::end(connections); ++loop) {
+        threads.emplace_back(&WebServer::acceptConnections, this, std::ref(*loop));
+    }
+    if (statsInterval.count() > 0) {
+        threads.emplace_back(&WebServer::logStats, this);
+    }
+    acceptConnections(connections.front());
+    for (auto& thread: threads) {
+        thread.join();
+    }
+}
+
+void WebServer::acceptConnections(Server& connection)
 {
     while (!finished)
     {
         Socket socket = connection.accept();
 
-        handleConnection(socket, contentDir);
+        handleConnection(socket, contentStore);
+    }
+}
+
+void WebServer::logStats()
+{
+    while (!finished)
+    {
+        std::this_thread::sleep_for(statsInterval);
+        ResponseCache::Stats const  response    = contentStore.getResponseCache().getStats();
+        ResponseCache::Stats const  compressed  = contentStore.getCompressedCache().getStats();
+        NISSE_LOG(Info, "Response Cache: hits: ", response.hits, " misses: ", response.misses, " evictions: ", response.evictions,
+                        " entries: ", response.entries, " bytes: ", response.bytes);
+        NISSE_LOG(Info, "Compressed Cache: hits: ", compressed.hits, " misses: ", compressed.misses, " evictions: ", compressed.evictions,
+                        " entries: ", compressed.entries, " bytes: ", compressed.bytes);
     }
 }
 
 // Server
 // ======
-Server::Server(int port)
+Server::Server(int port, ListenConfig const& config)
 {
     fd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (fd == -1) {
         throw std::runtime_error{Message{} << "Failed to create socket: " << errno << " " << strerror(errno)};
     }
 
+    int on = 1;
+    if (config.listeners > 1 && ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+        ::close(fd);
+        throw std::runtime_error{Message{} << "Failed to set SO_REUSEPORT: " << errno << " " << strerror(errno)};
+    }
+#ifdef TCP_DEFER_ACCEPT
+    if (config.deferAccept && ::setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &config.deferSeconds, sizeof(config.deferSeconds)) == -1) {
+        NISSE_LOG(Warning, "Failed to set TCP_DEFER_ACCEPT: ", errno, " ", strerror(errno));
+    }
+#endif
+
     struct ::sockaddr_in        serverAddr{};
     serverAddr.sin_family       = AF_INET;
     serverAddr.sin_port         = htons(port);
@@ -153,20 +254,35 @@ Server::Server(int port)
 
     int bindStatus = ::bind(fd, reinterpret_cast<struct ::sockaddr*>(&serverAddr), sizeof(serverAddr));
     if (bindStatus == -1) {
+        ::close(fd);
         throw std::runtime_error{Message{} << "Failed to bind socket: " << errno << " " << strerror(errno)};
     }
 
-    int listenStatus = ::listen(fd, backlog);
+    int listenStatus = ::listen(fd, config.backlog);
     if (listenStatus == -1) {
+        ::close(fd);
         throw std::runtime_error{Message{} << "Failed to listen socket: " << errno << " " << strerror(errno)};
     }
+#ifdef __linux__
+    if (config.uring)
+    {
+        try
+        {
+            ring = std::make_unique<Uring>();
+        }
+        catch (std::exception const& e)
+        {
+            NISSE_LOG(Warning, "No io_uring (using system calls): ", e.what());
+        }
+    }
+#endif
 }
 
 Server::~Server()
 {
     int closeStatus = ::close(fd);
     if (closeStatus == -1) {
-        std::cerr << "Failed to close Server: " << errno << " " << strerror(errno) << "\n";
+        NISSE_LOG(Error, "Failed to close Server: ", errno, " ", strerror(errno));
     }
 }
 
@@ -177,11 +293,35 @@ Socket Server::accept()
 
     while (true)
     {
+#ifdef __linux__
+        if (ring)
+        {
+            // The connection is blocking. The ring waits for it (see Socket.h).
+            int accept = ring->accept(fd);
+            if (accept == -1 && (errno == EINTR || errno == ECONNABORTED)) {
+                continue;
+            }
+            NISSE_LOG(Debug, "Accepted Connection");
+            if (accept == -1) {
+                throw std::runtime_error{Message{} << "Failed to accept socket: " << errno << " " << strerror(errno)};
+            }
+            return Socket{accept, ring.get()};
+        }
+#endif
+        // The connection is non blocking. The Socket waits with poll() when it can not read or write.
+#ifdef __linux__
+        int accept = ::accept4(fd, reinterpret_cast<struct ::sockaddr*>(&serverStorage), &addrSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
         int accept = ::accept(fd, reinterpret_cast<struct ::sockaddr*>(&serverStorage), &addrSize);
-        if (accept == -1 && errno == EINTR) {
+        if (accept != -1) {
+            ::fcntl(accept, F_SETFL, ::fcntl(accept, F_GETFL) | O_NONBLOCK);
+            ::fcntl(accept, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        if (accept == -1 && (errno == EINTR || errno == ECONNABORTED)) {
             continue;
         }
-        std::clog << "Accepted Connection\n";
+        NISSE_LOG(Debug, "Accepted Connection");
         if (accept == -1) {
             throw std::runtime_error{Message{} << "Failed to accept socket: " << errno << " " << strerror(errno)};
         }
@@ -189,204 +329,3 @@ Socket Server::accept()
     }
 }
 
-// Socket
-// ======
-Socket::Socket(int fd)
-    : fd{fd}
-    , readAvail{true}
-    , writeAvail{true}
-{
-    buffer.reserve(outputBufferMax);
-    outputBuffer.reserve(outputBufferMax);
-}
-
-Socket::~Socket()
-{
-    close();
-}
-
-Socket::Socket(Socket&& move) noexcept
-    : fd(-1)
-    , readAvail{false}
-    , writeAvail{false}
-{
-    swap(move);
-}
-
-Socket& Socket::operator=(Socket&& move) noexcept
-{
-    close();
-    swap(move);
-    return *this;
-}
-
-void Socket::swap(Socket& other) noexcept
-{
-    using std::swap;
-    swap(fd,            other.fd);
-    swap(buffer,        other.buffer);
-    swap(outputBuffer,  other.outputBuffer);
-    swap(currentLine,   other.currentLine);
-    swap(readAvail,     other.readAvail);
-    swap(writeAvail,    other.writeAvail);
-}
-
-void Socket::close()
-{
-    if (fd != 0)
-    {
-        int closeStatus = ::close(fd);
-        if (closeStatus == -1) {
-            std::cerr << "Failed to close socket: " << errno << " " << strerror(errno) << "\n";
-        }
-        fd = 0;
-        buffer.clear();
-        outputBuffer.clear();
-        currentLine ="";
-        readAvail = false;
-        writeAvail = false;
-    }
-}
-
-std::string_view Socket::getNextLine()
-{
-    removeCurrentLine();
-
-    if (checkLineInBuffer()) {
-        return currentLine;
-    }
-
-    while (readAvail)
-    {
-        readMoreData(inputBufferGrowth);
-        if (checkLineInBuffer()) {
-            return currentLine;
-        }
-    }
-
-    currentLine = {std::begin(buffer), std::end(buffer)};
-    return currentLine;
-}
-
-void Socket::ignore(std::size_t size)
-{
-    removeCurrentLine();
-    currentLine = "";
-
-    if (std::size(buffer) > size) {
-        std::move(std::begin(buffer) + size, std::end(buffer), std::begin(buffer));
-        buffer.resize(std::size(buffer) - size);
-        return;
-    }
-
-    size -= std::size(buffer);
-    buffer.clear();
-
-    readMoreData(size, true);
-    buffer.clear();
-}
-
-void Socket::removeCurrentLine()
-{
-    if (std::size(currentLine) == std::size(buffer)) {
-        buffer.clear();
-    }
-    else {
-        std::move(std::begin(buffer) + std::size(currentLine), std::end(buffer), std::begin(buffer));
-        buffer.resize(std::size(buffer) - std::size(currentLine));
-    }
-}
-
-bool Socket::checkLineInBuffer()
-{
-    std::string_view bufferView{std::begin(buffer), std::end(buffer)};
-    std::size_t find = bufferView.find("\r\n");
-    if (find != std::string_view::npos) {
-        currentLine = {std::begin(buffer), std::begin(buffer) + find + 2};
-        return true;
-    }
-    return false;
-}
-
-void Socket::readMoreData(std::size_t maxSize, bool required)
-{
-    // This function read "MoreData" onto the end of buffer.
-    // Note: There may be data already in buffer so this appends it.
-    //       We will read no more than "maxSize" more data into buffer.
-    // The required flag indicates if we must read "maxSize" if true
-    // the loop will continue until we get all the data otherwise the
-    // function returns after any data is received.
-    std::size_t     currentSize = std::size(buffer);
-    std::size_t     amountRead  = 0;
-    buffer.resize(currentSize + maxSize);
-
-    while (readAvail && amountRead != maxSize)
-    {
-        int nextChunk = ::read(fd, &buffer[0] + currentSize + amountRead, maxSize - amountRead);
-        if (nextChunk == -1 && errno == EINTR) {
-            continue;           // An interrupt can be ignored. Simply try again.
-        }
-        if (nextChunk == -1 && errno == ECONNRESET) {
-            readAvail = false;  // The client dropped the connection. Not a problem
-            break;              // But no more data can be read from the socket.
-        }
-        if (nextChunk == -1) {
-            buffer.resize(currentSize + amountRead);
-            throw std::runtime_error(Message{} << "Catastrophic read failure: " << errno << " " << strerror(errno));
-        }
-        if (nextChunk == 0) {   // The connection was closed gracefully.
-            readAvail = false;  // OS handled all the niceties.
-        }
-        amountRead += nextChunk;
-        if (!required) {
-            break;  // have some data. Lets exit and see if it is enough.
-        }
-    }
-    // Make sure to set the buffer to the correct size.
-    buffer.resize(currentSize + amountRead);
-}
-
-void Socket::sendMessage(std::string const& message)
-{
-    if (!writeAvail) {
-        return;
-    }
-    if (outputBuffer.size() + message.size() > outputBufferMax)
-    {
-        sync();
-        sendData(&message[0], std::size(message));
-    }
-    else {
-        std::copy(std::begin(message), std::end(message), std::back_inserter(outputBuffer));
-    }
-}
-
-void Socket::sync()
-{
-    if (std::size(outputBuffer) > 0)
-    {
-        sendData(&outputBuffer[0], std::size(outputBuffer));
-        outputBuffer.clear();
-    }
-}
-
-void Socket::sendData(char const* data, std::size_t size)
-{
-    std::size_t sentData = 0;
-    while (writeAvail && sentData != size)
-    {
-        ::ssize_t writeStatus = ::write(fd, data + sentData, size - sentData);
-        if (writeStatus == -1 && errno == EINTR) {
-            continue;
-        }
-        if (writeStatus == -1 && errno == ECONNRESET) {
-            writeAvail = false;
-            break;
-        }
-        if (writeStatus == -1) {
-            throw std::runtime_error(Message{} << "Failed to write: " << fd << " Code: " << errno << " " << strerror(errno));
-        }
-        sentData += writeStatus;
-    }
-}
-
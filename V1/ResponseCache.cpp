@@ -0,0 +1,96 @@
+#include "ResponseCache.h"
+#include "ContentWatcher.h"
+
+ResponseCache::ResponseCache(std::size_t maxBytes, std::size_t maxFileSize, std::chrono::milliseconds expireAfter)
+    : maxBytes{maxBytes}
+    , maxFileSize{maxFileSize}
+    , expireAfter{expireAfter}
+    , bytes{0}
+    , changes{0}
+    , hits{0}
+    , misses{0}
+    , evictions{0}
+{}
+
+ResponseCache::Response ResponseCache::find(std::string const& key)
+{
+    std::unique_lock    lock(cacheMutex);
+    auto find = entries.find(key);
+    if (find == std::end(entries)) {
+        ++misses;
+        return nullptr;
+    }
+    if (find->second->expires < Clock::now()) {
+        erase(find);
+        ++misses;
+        return nullptr;
+    }
+    lru.splice(std::begin(lru), lru, find->second);
+    ++hits;
+    return find->second->response;
+}
+
+void ResponseCache::insert(std::string const& key, std::filesystem::path const& file, Response response, bool watched, std::uint64_t generation)
+{
+    std::size_t size = std::size(*response) + std::size(key);
+    if (size > maxBytes) {
+        return;
+    }
+
+    std::unique_lock    lock(cacheMutex);
+    // Checked under the lock: invalidate() changes it under the same lock.
+    // So either the change was seen here or invalidate() will remove this entry.
+    if (changes.load(std::memory_order_relaxed) != generation) {
+        return;
+    }
+    auto find = entries.find(key);
+    if (find != std::end(entries)) {
+        erase(find);
+    }
+
+    lru.push_front(Entry{key, file, std::move(response), watched ? Clock::time_point::max() : Clock::now() + expireAfter});
+    entries.emplace(key, std::begin(lru));
+    bytes += size;
+
+    while (bytes > maxBytes)
+    {
+        erase(entries.find(lru.back().key));
+        ++evictions;
+    }
+}
+
+void ResponseCache::erase(std::string const& key)
+{
+    std::unique_lock    lock(cacheMutex);
+    auto find = entries.find(key);
+    if (find != std::end(entries)) {
+        erase(find);
+    }
+}
+
+void ResponseCache::invalidate(std::filesystem::path const& changed)
+{
+    std::unique_lock    lock(cacheMutex);
+    changes.fetch_add(1, std::memory_order_release);
+    for (auto loop = std::begin(lru); loop != std::end(lru);)
+    {
+        auto next = std::next(loop);
+        if (ContentWatcher::affects(changed, loop->file)) {
+            erase(entries.find(loop->key));
+        }
+        loop = next;
+    }
+}
+
+ResponseCache::Stats ResponseCache::getStats() const
+{
+    std::unique_lock    lock(cacheMutex);
+    return {hits, misses, evictions, std::size(entries), bytes};
+}
+
+void ResponseCache::erase(EntryMap::iterator find)
+{
+    bytes -= std::size(*find->second->response) + std::size(find->second->key);
+    lru.erase(find->second);
+    entries.erase(find);
+}
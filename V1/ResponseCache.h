@@ -0,0 +1,98 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+/*
+ * ResponseCache:   A memory budgeted LRU cache of complete responses for small files.
+ *
+ * Each entry is the fully serialized response (status line, headers and body) in a single
+ * contiguous buffer. So a hit can be sent with one write and no file system access.
+ *
+ * Entries for files in directories watched by the ContentWatcher are kept until invalidate()
+ * is called for the file. Other entries expire after "expireAfter" as there is no other way to
+ * notice that the file changed.
+ * A response is built from the file after the cache was checked. So a change that is reported
+ * (and invalidated) while it is being built would be missed. To prevent this read generation()
+ * before looking at the file and pass it to insert(): If anything was invalidated since then the
+ * response is not cached (the next request builds it again).
+ * The buffers are held by std::shared_ptr so an entry that is being sent while it is
+ * evicted stays valid until the send completes.
+ *
+ * All public methods are thread safe.
+ */
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+class ResponseCache
+{
+    public:
+        using Response  = std::shared_ptr<std::string const>;
+        struct Stats
+        {
+            std::size_t     hits;
+            std::size_t     misses;
+            std::size_t     evictions;
+            std::size_t     entries;
+            std::size_t     bytes;
+        };
+
+    private:
+        using Clock     = std::chrono::steady_clock;
+        struct Entry
+        {
+            std::string             key;
+            std::filesystem::path   file;
+            Response                response;
+            Clock::time_point       expires;
+        };
+        using LRUList   = std::list<Entry>;
+        using EntryMap  = std::unordered_map<std::string, LRUList::iterator>;
+
+        std::size_t const           maxBytes;
+        std::size_t const           maxFileSize;
+        Clock::duration const       expireAfter;
+
+        mutable std::mutex          cacheMutex;
+        LRUList                     lru;            // Most recently used at the front.
+        EntryMap                    entries;
+        std::size_t                 bytes;
+        std::atomic<std::uint64_t>  changes;        // Incremented (under the lock) by invalidate().
+
+        std::atomic<std::size_t>    hits;
+        std::atomic<std::size_t>    misses;
+        std::atomic<std::size_t>    evictions;
+
+    public:
+        ResponseCache(std::size_t maxBytes, std::size_t maxFileSize, std::chrono::milliseconds expireAfter);
+
+        ResponseCache(ResponseCache const&)             = delete;
+        ResponseCache& operator=(ResponseCache const&)  = delete;
+
+        // Files larger than this are never cached.
+        bool        cacheable(std::size_t fileSize) const  {return fileSize <= maxFileSize;}
+        std::size_t maxSize()                       const  {return maxFileSize;}
+
+        Response    find(std::string const& key);
+        // Read before looking at the file the response is built from (see insert()).
+        std::uint64_t generation() const            {return changes.load(std::memory_order_acquire);}
+        // If "watched" is true the entry does not expire (the file is watched for changes).
+        // "generation" is the value of generation() before the file was looked at.
+        void        insert(std::string const& key, std::filesystem::path const& file, Response response, bool watched, std::uint64_t generation);
+        void        erase(std::string const& key);
+        // Remove all entries for "changed" (or for files inside it if it is a directory).
+        void        invalidate(std::filesystem::path const& changed);
+        Stats       getStats() const;
+
+    private:
+        void        erase(EntryMap::iterator find);
+};
+
+#endif
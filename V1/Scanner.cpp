@@ -0,0 +1,128 @@
+#include "Scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCANNER_X86
+#endif
+
+namespace
+{
+
+std::size_t findAnyScalar(char const* data, std::size_t size, char a, char b, char c)
+{
+    for (std::size_t loop = 0; loop < size; ++loop)
+    {
+        char next = data[loop];
+        if (next == a || next == b || next == c) {
+            return loop;
+        }
+    }
+    return size;
+}
+
+#ifdef HTTP_SCANNER_X86
+__attribute__((target("sse2")))
+std::size_t findAnySSE2(char const* data, std::size_t size, char a, char b, char c)
+{
+    __m128i     matchA  = _mm_set1_epi8(a);
+    __m128i     matchB  = _mm_set1_epi8(b);
+    __m128i     matchC  = _mm_set1_epi8(c);
+
+    std::size_t loop = 0;
+    for (; loop + 16 <= size; loop += 16)
+    {
+        __m128i block   = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + loop));
+        __m128i match   = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, matchA), _mm_cmpeq_epi8(block, matchB)), _mm_cmpeq_epi8(block, matchC));
+        unsigned mask   = _mm_movemask_epi8(match);
+        if (mask != 0) {
+            return loop + __builtin_ctz(mask);
+        }
+    }
+    return loop + findAnyScalar(data + loop, size - loop, a, b, c);
+}
+
+__attribute__((target("avx2")))
+std::size_t findAnyAVX2(char const* data, std::size_t size, char a, char b, char c)
+{
+    __m256i     matchA  = _mm256_set1_epi8(a);
+    __m256i     matchB  = _mm256_set1_epi8(b);
+    __m256i     matchC  = _mm256_set1_epi8(c);
+
+    std::size_t loop = 0;
+    for (; loop + 32 <= size; loop += 32)
+    {
+        __m256i block   = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + loop));
+        __m256i match   = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, matchA), _mm256_cmpeq_epi8(block, matchB)), _mm256_cmpeq_epi8(block, matchC));
+        unsigned mask   = _mm256_movemask_epi8(match);
+        if (mask != 0) {
+            return loop + __builtin_ctz(mask);
+        }
+    }
+    // Let SSE2 handle the tail (it will drop to scalar for the last few bytes).
+    return loop + findAnySSE2(data + loop, size - loop, a, b, c);
+}
+#endif
+
+using FindAnyFunction = std::size_t(*)(char const*, std::size_t, char, char, char);
+
+FindAnyFunction selectFindAny()
+{
+#ifdef HTTP_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &findAnyAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &findAnySSE2;
+    }
+#endif
+    return &findAnyScalar;
+}
+
+}
+
+std::size_t findAny(char const* data, std::size_t size, char a, char b, char c)
+{
+    static FindAnyFunction const findAnyImplementation = selectFindAny();
+    return findAnyImplementation(data, size, a, b, c);
+}
+
+bool LineScanner::scan(std::string_view data)
+{
+    if (info.lineEnd != LineInfo::npos) {
+        return true;
+    }
+
+    char const* begin = std::data(data);
+    std::size_t size  = std::size(data);
+    while (scanned < size)
+    {
+        // Only look for the separators we have not found yet.
+        // Once all are found we just look for the end of line.
+        char colon  = info.colon  == LineInfo::npos ? ':' : '\n';
+        char space  = info.space2 == LineInfo::npos ? ' ' : '\n';
+        std::size_t find = scanned + findAny(begin + scanned, size - scanned, '\n', colon, space);
+        if (find == size) {
+            break;
+        }
+        scanned = find + 1;
+
+        switch (begin[find])
+        {
+            case ':':
+                info.colon = find;
+                break;
+            case ' ':
+                (info.space1 == LineInfo::npos ? info.space1 : info.space2) = find;
+                break;
+            default: // '\n'
+                if (find != 0 && begin[find - 1] == '\r') {
+                    info.lineEnd = find + 1;
+                    return true;
+                }
+                break;
+        }
+    }
+    scanned = size;
+    return false;
+}
@@ -0,0 +1,55 @@
+#ifndef HTTP_SCANNER_H
+#define HTTP_SCANNER_H
+
+/*
+ * Tools for finding the interesting characters in HTTP data.
+ *
+ * findAny():       Find the first occurrence of any of three characters.
+ *                  Uses AVX2 or SSE2 when the CPU supports them (decided once at runtime)
+ *                  with a simple scalar loop as the fallback.
+ *
+ * LineScanner:     Finds the end of a line ("\r\n") and at the same time records the
+ *                  position of the first ':' and the first two ' ' characters. These are
+ *                  the separators needed to split the request line and the headers.
+ *                  The scanner remembers how far it got so when more data is appended
+ *                  to the buffer only the new data is scanned.
+ */
+
+#include <string_view>
+#include <cstddef>
+
+// Returns the index of the first character in data that is 'a', 'b' or 'c'.
+// If there is no such character then returns size.
+std::size_t findAny(char const* data, std::size_t size, char a, char b, char c);
+
+struct LineInfo
+{
+    static constexpr std::size_t npos = std::string_view::npos;
+
+    // All positions are relative to the start of the line.
+    std::size_t     lineEnd = npos;     // One past the "\r\n"
+    std::size_t     colon   = npos;     // First ':'
+    std::size_t     space1  = npos;     // First ' '
+    std::size_t     space2  = npos;     // Second ' '
+};
+
+class LineScanner
+{
+    std::size_t     scanned;
+    LineInfo        info;
+    public:
+        LineScanner()
+            : scanned{0}
+        {}
+
+        // "data" must start at the beginning of the current line.
+        // It may be longer than the last call (more data was read) but the previous
+        // content must not have changed. Returns true once a full line has been found.
+        bool scan(std::string_view data);
+        // Call when the current line has been consumed.
+        void reset()                            {scanned = 0;info = LineInfo{};}
+
+        LineInfo const& getInfo() const         {return info;}
+};
+
+#endif
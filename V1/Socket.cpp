@@ -0,0 +1,537 @@
+#include "Socket.h"
+#include "Uring.h"
+#include "ContentStore.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <climits>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// Socket
+// ======
+Socket::Socket(int fd, Uring* ring)
+    : fd{fd}
+    , ring{ring}
+    , buffer(inputBufferSize)
+    , dataStart{0}
+    , dataEnd{0}
+    , readAvail{true}
+    , writeAvail{true}
+{
+    outputBuffer.reserve(outputBufferMax);
+    outputChunks.reserve(16);
+    outputIOV.reserve(16);
+}
+
+Socket::~Socket()
+{
+    close();
+}
+
+Socket::Socket(Socket&& move) noexcept
+    : fd(-1)
+    , ring{nullptr}
+    , dataStart{0}
+    , dataEnd{0}
+    , readAvail{false}
+    , writeAvail{false}
+{
+    swap(move);
+}
+
+Socket& Socket::operator=(Socket&& move) noexcept
+{
+    close();
+    swap(move);
+    return *this;
+}
+
+void Socket::swap(Socket& other) noexcept
+{
+    using std::swap;
+    swap(fd,            other.fd);
+    swap(ring,          other.ring);
+    swap(buffer,        other.buffer);
+    swap(dataStart,     other.dataStart);
+    swap(dataEnd,       other.dataEnd);
+    swap(lineScanner,   other.lineScanner);
+    swap(outputBuffer,  other.outputBuffer);
+    swap(outputChunks,  other.outputChunks);
+    swap(outputIOV,     other.outputIOV);
+    swap(currentLine,   other.currentLine);
+    swap(readAvail,     other.readAvail);
+    swap(writeAvail,    other.writeAvail);
+}
+
+void Socket::close()
+{
+    if (fd != 0)
+    {
+        int closeStatus = ::close(fd);
+        if (closeStatus == -1) {
+            NISSE_LOG(Error, "Failed to close socket: ", errno, " ", strerror(errno));
+        }
+        fd = 0;
+        dataStart = 0;
+        dataEnd = 0;
+        lineScanner.reset();
+        outputBuffer.clear();
+        outputChunks.clear();
+        currentLine ="";
+        readAvail = false;
+        writeAvail = false;
+    }
+}
+
+std::string_view Socket::getNextLine()
+{
+    removeCurrentLine();
+
+    if (checkLineInBuffer()) {
+        return currentLine;
+    }
+
+    while (readAvail)
+    {
+        // Read as much as will fit in the buffer (but at least inputBufferGrowth).
+        makeSpace(inputBufferGrowth);
+        readMoreData(std::size(buffer) - dataEnd);
+        if (checkLineInBuffer()) {
+            return currentLine;
+        }
+    }
+
+    currentLine = {&buffer[0] + dataStart, &buffer[0] + dataEnd};
+    return currentLine;
+}
+
+void Socket::ignore(std::size_t size)
+{
+    // Discard through a fixed size scratch buffer.
+    // So skipping a large body does not grow "buffer" to the size of the body.
+    char    scratch[bodyChunkSize];
+    while (size != 0)
+    {
+        std::size_t amountRead = readBody(scratch, std::min(size, sizeof(scratch)));
+        if (amountRead == 0) {
+            break;
+        }
+        size -= amountRead;
+    }
+}
+
+std::size_t Socket::readBody(char* dst, std::size_t size)
+{
+    removeCurrentLine();
+    currentLine = "";
+    if (size == 0) {
+        // A read() of 0 bytes returns 0: That would look like the connection was closed.
+        return 0;
+    }
+
+    // Data that was read along with the headers comes first.
+    std::size_t buffered = std::min(size, dataEnd - dataStart);
+    if (buffered != 0)
+    {
+        std::copy(&buffer[0] + dataStart, &buffer[0] + dataStart + buffered, dst);
+        consume(buffered);
+        return buffered;
+    }
+    // Then read straight into the caller's buffer (not through "buffer").
+    return readSocket(dst, size);
+}
+
+std::size_t Socket::spliceTo(int fileFd, std::size_t size)
+{
+    removeCurrentLine();
+    currentLine = "";
+
+    // Data that was read along with the headers comes first.
+    std::size_t written = std::min(size, dataEnd - dataStart);
+    writeFile(fileFd, &buffer[0] + dataStart, written);
+    consume(written);
+
+#ifdef __linux__
+    // The rest is moved socket => pipe => file inside the kernel.
+    // So the body is never copied into user space.
+    int pipeFd[2];
+    if (written != size && readAvail && ::pipe2(pipeFd, O_CLOEXEC) == 0)
+    {
+        try
+        {
+            while (written != size && readAvail)
+            {
+                ::ssize_t in = ::splice(fd, nullptr, pipeFd[1], nullptr, size - written, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (in == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (in == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    waitFor(POLLIN);
+                    continue;
+                }
+                if (in == -1 && errno == EINVAL) {
+                    break;              // Not supported: Use the generic version below.
+                }
+                if (in == -1 && errno == ECONNRESET) {
+                    readAvail = false;
+                    break;
+                }
+                if (in == -1) {
+                    throw std::runtime_error(Message{} << "Failed to splice from socket: " << fd << " Code: " << errno << " " << strerror(errno));
+                }
+                if (in == 0) {
+                    readAvail = false;
+                    break;
+                }
+                for (::ssize_t left = in; left != 0;)
+                {
+                    ::ssize_t out = ::splice(pipeFd[0], nullptr, fileFd, nullptr, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+                    if (out == -1 && errno == EINTR) {
+                        continue;
+                    }
+                    if (out == -1 && errno == EINVAL)
+                    {
+                        // The file does not support splice: Copy what is in the pipe by hand.
+                        char    scratch[bodyChunkSize];
+                        ::ssize_t readStatus = ::read(pipeFd[0], scratch, std::min<std::size_t>(left, sizeof(scratch)));
+                        if (readStatus <= 0) {
+                            throw std::runtime_error(Message{} << "Failed to read pipe: " << errno << " " << strerror(errno));
+                        }
+                        writeFile(fileFd, scratch, readStatus);
+                        out = readStatus;
+                    }
+                    if (out == -1) {
+                        throw std::runtime_error(Message{} << "Failed to splice to file: " << fileFd << " Code: " << errno << " " << strerror(errno));
+                    }
+                    left -= out;
+                }
+                written += in;
+            }
+        }
+        catch (...)
+        {
+            ::close(pipeFd[0]);
+            ::close(pipeFd[1]);
+            throw;
+        }
+        ::close(pipeFd[0]);
+        ::close(pipeFd[1]);
+    }
+#endif
+    if (written != size && readAvail) {
+        written += Stream::spliceTo(fileFd, size - written);
+    }
+    return written;
+}
+
+void Socket::removeCurrentLine()
+{
+    // Note: currentLine always starts at dataStart.
+    consume(std::size(currentLine));
+}
+
+void Socket::consume(std::size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    // The start of the line has moved so any scan so far is invalid.
+    lineScanner.reset();
+    dataStart += size;
+    if (dataStart == dataEnd) {
+        // Buffer is empty. Reset to the front for free.
+        dataStart   = 0;
+        dataEnd     = 0;
+    }
+}
+
+bool Socket::checkLineInBuffer()
+{
+    // Note: The scanner remembers where it got to on the previous call.
+    //       So only data added by the last read is scanned.
+    std::string_view bufferView{&buffer[0] + dataStart, &buffer[0] + dataEnd};
+    if (lineScanner.scan(bufferView)) {
+        currentLine = bufferView.substr(0, lineScanner.getInfo().lineEnd);
+        return true;
+    }
+    return false;
+}
+
+void Socket::makeSpace(std::size_t size)
+{
+    // Make sure there are at least "size" bytes free at the end of buffer.
+    if (std::size(buffer) - dataEnd >= size) {
+        return;
+    }
+    // Reclaim the space of consumed data at the front of the buffer.
+    // This is the only place that data is moved.
+    if (dataStart != 0)
+    {
+        std::move(std::begin(buffer) + dataStart, std::begin(buffer) + dataEnd, std::begin(buffer));
+        dataEnd    -= dataStart;
+        dataStart   = 0;
+    }
+    if (std::size(buffer) - dataEnd < size) {
+        buffer.resize(std::max(dataEnd + size, std::size(buffer) * 2));
+    }
+}
+
+void Socket::readMoreData(std::size_t maxSize, bool required)
+{
+    // This function read "MoreData" onto the end of buffer.
+    // Note: There may be data already in buffer so this appends it.
+    //       We will read no more than "maxSize" more data into buffer.
+    // The required flag indicates if we must read "maxSize" if true
+    // the loop will continue until we get all the data otherwise the
+    // function returns after any data is received.
+    makeSpace(maxSize);
+    std::size_t     amountRead  = 0;
+
+    while (readAvail && amountRead != maxSize)
+    {
+        std::size_t nextChunk = readSocket(&buffer[0] + dataEnd, maxSize - amountRead);
+        amountRead += nextChunk;
+        dataEnd    += nextChunk;
+        if (!required) {
+            break;  // have some data. Lets exit and see if it is enough.
+        }
+    }
+}
+
+std::size_t Socket::readSocket(char* dst, std::size_t size)
+{
+    // A single read() from the socket.
+    // Returns 0 (and marks the socket as having no more input) when the connection is closed.
+    while (readAvail)
+    {
+#ifdef __linux__
+        ::ssize_t nextChunk = ring != nullptr ? ring->recv(fd, dst, size) : ::read(fd, dst, size);
+#else
+        ::ssize_t nextChunk = ::read(fd, dst, size);
+#endif
+        if (nextChunk == -1 && errno == EINTR) {
+            continue;           // An interrupt can be ignored. Simply try again.
+        }
+        if (nextChunk == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitFor(POLLIN);    // No data yet.
+            continue;
+        }
+        if (nextChunk == -1 && errno == ECONNRESET) {
+            readAvail = false;  // The client dropped the connection. Not a problem
+            break;              // But no more data can be read from the socket.
+        }
+        if (nextChunk == -1) {
+            throw std::runtime_error(Message{} << "Catastrophic read failure: " << errno << " " << strerror(errno));
+        }
+        if (nextChunk == 0) {   // The connection was closed gracefully.
+            readAvail = false;  // OS handled all the niceties.
+        }
+        return nextChunk;
+    }
+    return 0;
+}
+
+void Socket::sendMessage(std::string_view message)
+{
+    if (!writeAvail) {
+        return;
+    }
+    // The message is normally a temporary so we must take a copy.
+    std::size_t offset = std::size(outputBuffer);
+    outputBuffer.insert(std::end(outputBuffer), std::begin(message), std::end(message));
+    addOwnedChunk(offset, std::size(message));
+}
+
+void Socket::sendReference(std::string_view message)
+{
+    if (!writeAvail || message.empty()) {
+        return;
+    }
+    outputChunks.push_back({std::data(message), 0, std::size(message)});
+}
+
+void Socket::addOwnedChunk(std::size_t offset, std::size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    // Consecutive copies into outputBuffer are merged into a single chunk.
+    if (!outputChunks.empty() && outputChunks.back().data == nullptr && outputChunks.back().offset + outputChunks.back().size == offset) {
+        outputChunks.back().size += size;
+    }
+    else {
+        outputChunks.push_back({nullptr, offset, size});
+    }
+    // Put a limit on how much we are prepared to hold onto.
+    if (std::size(outputBuffer) > outputBufferMax) {
+        sync();
+    }
+}
+
+void Socket::sync()
+{
+    if (outputChunks.empty()) {
+        return;
+    }
+    gatherOutput();
+    sendData(&outputIOV[0], std::size(outputIOV));
+    outputBuffer.clear();
+    outputChunks.clear();
+}
+
+void Socket::gatherOutput()
+{
+    // Note: outputBuffer may have been reallocated while chunks were added.
+    //       So the addresses of owned chunks are only calculated now.
+    outputIOV.clear();
+    for (auto const& chunk: outputChunks)
+    {
+        char const* data = chunk.data != nullptr ? chunk.data : &outputBuffer[0] + chunk.offset;
+        outputIOV.push_back({const_cast<char*>(data), chunk.size});
+    }
+}
+
+void Socket::sendFileRange(int fileFd, std::size_t offset, std::size_t size)
+{
+    static constexpr std::size_t    smallFileMax = 16 * 1024;
+
+    if (!writeAvail) {
+        return;
+    }
+    if (size <= smallFileMax)
+    {
+        // Small files are copied into outputBuffer behind the headers.
+        // So the whole response goes out in a single writev() on sync().
+        std::size_t bufferOffset = std::size(outputBuffer);
+        outputBuffer.resize(bufferOffset + size);
+        std::size_t amountRead = 0;
+        while (amountRead != size)
+        {
+            ::ssize_t readStatus = ::pread(fileFd, &outputBuffer[0] + bufferOffset + amountRead, size - amountRead, offset + amountRead);
+            if (readStatus == -1 && errno == EINTR) {
+                continue;
+            }
+            if (readStatus == -1 || readStatus == 0) {
+                outputBuffer.resize(bufferOffset);
+                throw std::runtime_error(Message{} << "Failed to read file: " << fileFd << " Code: " << errno << " " << strerror(errno));
+            }
+            amountRead += readStatus;
+        }
+        addOwnedChunk(bufferOffset, size);
+        return;
+    }
+#ifdef __linux__
+    if (ring != nullptr && std::size(outputChunks) <= IOV_MAX)
+    {
+        // The buffered headers and the file content go out as one chain of linked entries.
+        gatherOutput();
+        int sendStatus = ring->sendFile(fd, std::data(outputIOV), std::size(outputIOV), fileFd, offset, size);
+        outputBuffer.clear();
+        outputChunks.clear();
+        if (sendStatus == -1 && (errno == ECONNRESET || errno == EPIPE)) {
+            writeAvail = false;
+        }
+        else if (sendStatus == -1 && errno == ENODATA) {
+            throw std::runtime_error(Message{} << "File truncated while sending: " << fileFd);
+        }
+        else if (sendStatus == -1) {
+            throw std::runtime_error(Message{} << "Failed to send file: " << fd << " Code: " << errno << " " << strerror(errno));
+        }
+        return;
+    }
+    // Anything buffered must go out before the file content.
+    sync();
+
+    // Let the kernel copy from the page cache directly to the socket.
+    ::off_t     fileOffset = offset;
+    while (writeAvail && size != 0)
+    {
+        ::ssize_t sendStatus = ::sendfile(fd, fileFd, &fileOffset, size);
+        if (sendStatus == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sendStatus == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitFor(POLLOUT);
+            continue;
+        }
+        if (sendStatus == -1 && (errno == ECONNRESET || errno == EPIPE)) {
+            writeAvail = false;
+            break;
+        }
+        if (sendStatus == -1 && (errno == EINVAL || errno == ENOSYS)) {
+            // The file (or socket) does not support sendfile().
+            // Fall back to the generic buffered copy for whatever is left.
+            Stream::sendFileRange(fileFd, fileOffset, size);
+            return;
+        }
+        if (sendStatus == -1) {
+            throw std::runtime_error(Message{} << "Failed to sendfile: " << fd << " Code: " << errno << " " << strerror(errno));
+        }
+        if (sendStatus == 0) {
+            throw std::runtime_error(Message{} << "File truncated while sending: " << fileFd);
+        }
+        size -= sendStatus;
+    }
+#else
+    Stream::sendFileRange(fileFd, offset, size);
+#endif
+}
+
+void Socket::sendData(::iovec* iov, std::size_t count)
+{
+    while (writeAvail && count != 0)
+    {
+#ifdef __linux__
+        ::ssize_t writeStatus = ring != nullptr ? ring->send(fd, iov, std::min<std::size_t>(count, IOV_MAX))
+                                                : ::writev(fd, iov, static_cast<int>(std::min<std::size_t>(count, IOV_MAX)));
+#else
+        ::ssize_t writeStatus = ::writev(fd, iov, static_cast<int>(std::min<std::size_t>(count, IOV_MAX)));
+#endif
+        if (writeStatus == -1 && errno == EINTR) {
+            continue;
+        }
+        if (writeStatus == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitFor(POLLOUT);
+            continue;
+        }
+        if (writeStatus == -1 && (errno == ECONNRESET || errno == EPIPE)) {
+            writeAvail = false;
+            break;
+        }
+        if (writeStatus == -1) {
+            throw std::runtime_error(Message{} << "Failed to write: " << fd << " Code: " << errno << " " << strerror(errno));
+        }
+        // Skip over the buffers that were completely written.
+        // Then adjust the first partially written buffer (if any).
+        std::size_t written = writeStatus;
+        while (count != 0 && written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count != 0)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+void Socket::waitFor(short events)
+{
+    // The socket is non blocking: Block in poll() until it is ready.
+    ::pollfd    pollFd{fd, events, 0};
+    while (::poll(&pollFd, 1, -1) == -1 && errno == EINTR)
+    {}
+}
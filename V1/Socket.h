@@ -0,0 +1,98 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+/*
+ * Socket:  A Unix socket connection that has been established.
+ *          It acts like a bi-directional communication channel.
+ *          It has an internal buffer to track requests.
+ *
+ * The descriptor must be non blocking: The Socket waits with poll() when it can not read or write.
+ *
+ * Linux: With a Uring (see Uring.h) reads, writes and large files go through the ring instead.
+ *        Then the descriptor must be blocking (the ring does the waiting) and the Uring must
+ *        outlive the Socket.
+ */
+
+#include "Stream.h"
+#include "Scanner.h"
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+#include <sys/uio.h>
+
+class Uring;
+
+class Socket final: public Stream
+{
+    // An output chunk is either a reference to data owned by the caller (data != nullptr)
+    // or a range of bytes that were copied into outputBuffer (data == nullptr).
+    struct OutputChunk
+    {
+        char const*     data;
+        std::size_t     offset;
+        std::size_t     size;
+    };
+
+    static constexpr std::size_t    inputBufferSize   = 4096;
+    static constexpr std::size_t    inputBufferGrowth = 500;
+    static constexpr std::size_t    outputBufferMax   = 16 * 1024;
+    static constexpr std::size_t    bodyChunkSize     = 16 * 1024;
+    int                 fd;
+    Uring*              ring;
+    // Input data is the range [dataStart, dataEnd) of "buffer".
+    // Consuming data simply moves dataStart forward. The data is only
+    // moved back to the front when we run out of space at the end.
+    std::vector<char>   buffer;
+    std::size_t         dataStart;
+    std::size_t         dataEnd;
+    LineScanner         lineScanner;
+    // Output is queued as a list of chunks and written with a single writev() on sync().
+    std::vector<char>           outputBuffer;
+    std::vector<OutputChunk>    outputChunks;
+    std::vector<::iovec>        outputIOV;
+    std::string_view    currentLine;
+    bool                readAvail;
+    bool                writeAvail;
+    public:
+        Socket(int fd, Uring* ring = nullptr);
+        ~Socket();
+
+        Socket(Socket&& move)               noexcept;
+        Socket& operator=(Socket&& move)    noexcept;
+        void swap(Socket& other)            noexcept;
+
+        friend void swap(Socket& lhs, Socket& rhs)  {lhs.swap(rhs);}
+
+        Socket(Socket const&)               = delete;
+        Socket& operator=(Socket const&)    = delete;
+
+        std::string_view    getNextLine()   override;
+        LineInfo            getLineInfo(std::string_view) const override {return lineScanner.getInfo();}
+        void ignore(std::size_t size)       override;
+        std::size_t readBody(char* dst, std::size_t size)       override;
+        std::size_t spliceTo(int fileFd, std::size_t size)      override;
+
+        void sendMessage(std::string_view message)      override;
+        void sendReference(std::string_view message)    override;
+        void sync()                                     override;
+        void sendFileRange(int fileFd, std::size_t offset, std::size_t size) override;
+
+        bool isOpen()   const {return fd != 0;}
+        bool hasData()  const   override {return dataStart != dataEnd || readAvail;}
+        void close()            override;
+    private:
+        void removeCurrentLine();
+        void consume(std::size_t size);
+        bool checkLineInBuffer();
+        void makeSpace(std::size_t size);
+        void readMoreData(std::size_t maxSize, bool required = false);
+        std::size_t readSocket(char* dst, std::size_t size);
+        void addOwnedChunk(std::size_t offset, std::size_t size);
+        void gatherOutput();
+        void sendData(::iovec* iov, std::size_t count);
+        void waitFor(short events);
+};
+
+#endif
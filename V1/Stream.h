@@ -1,18 +1,99 @@
 #ifndef STREAM_INTERFACE_H
 #define STREAM_INTERFACE_H
 
+#include "Scanner.h"
+
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <filesystem>
+#include <memory>
+#include <algorithm>
+#include <charconv>
+#include <type_traits>
+#include <concepts>
+#include <cstddef>
 
+/*
+ * Message: Builds a string with operator<<.
+ *
+ * Text is formatted straight into an inline buffer (numbers with std::to_chars) so building a
+ * header or error message does not allocate, create a stream or look at the locale. Only text
+ * longer than the inline buffer moves to the heap.
+ * A Message converts to std::string_view, so it can be passed directly to Stream::sendMessage()
+ * which copies it into the stream's output buffer with no intermediate std::string.
+ */
 class Message
 {
-    std::stringstream   ss;
+    static constexpr std::size_t    inlineSize = 256;
+
+    char                        inlineBuffer[inlineSize];
+    std::unique_ptr<char[]>     heapBuffer;
+    char*                       data;
+    std::size_t                 size;
+    std::size_t                 capacity;
+
     public:
+        Message()
+            : data{inlineBuffer}
+            , size{0}
+            , capacity{inlineSize}
+        {}
+        Message(Message const&)             = delete;
+        Message& operator=(Message const&)  = delete;
+
+        Message& operator<<(std::string_view value)     {append(std::data(value), std::size(value));return *this;}
+        Message& operator<<(std::string const& value)   {append(std::data(value), std::size(value));return *this;}
+        Message& operator<<(char const* value)          {return *this << std::string_view{value};}
+        Message& operator<<(char value)                 {append(&value, 1);return *this;}
+        // Paths are quoted (the same as the iostream version).
+        Message& operator<<(std::filesystem::path const& value)
+        {
+            std::string const&  name = value.native();
+            reserve(std::size(name) * 2 + 2);
+            data[size++] = '"';
+            for (char c: name)
+            {
+                if (c == '"' || c == '\\') {
+                    data[size++] = '\\';
+                }
+                data[size++] = c;
+            }
+            data[size++] = '"';
+            return *this;
+        }
         template<typename T>
-        Message& operator<<(T const& data) {ss << data;return *this;}
+        requires (std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>)
+        Message& operator<<(T value)
+        {
+            static constexpr std::size_t maxDigits = 24;
+            reserve(maxDigits);
+            size = std::to_chars(data + size, data + capacity, value).ptr - data;
+            return *this;
+        }
+
+        std::string_view    view()                  const   {return {data, size};}
+        operator std::string_view()                 const   {return view();}
+        operator std::string()                      const   {return std::string{data, size};}
 
-        operator std::string() {return ss.str();}
+    private:
+        void append(char const* value, std::size_t length)
+        {
+            reserve(length);
+            std::copy(value, value + length, data + size);
+            size += length;
+        }
+        void reserve(std::size_t extra)
+        {
+            if (size + extra <= capacity) {
+                return;
+            }
+            std::size_t             newCapacity = std::max(capacity * 2, size + extra);
+            std::unique_ptr<char[]> newBuffer(new char[newCapacity]);
+            std::copy(data, data + size, newBuffer.get());
+            heapBuffer  = std::move(newBuffer);
+            data        = heapBuffer.get();
+            capacity    = newCapacity;
+        }
 };
 
 class Stream
@@ -21,15 +102,76 @@ class Stream
         virtual ~Stream()   {}
 
         virtual std::string_view    getNextLine()               = 0;
+        // The separators in "line" (the line just returned by getNextLine()).
+        // A stream that scans its input for the end of line records them as it goes and
+        // returns those (so the request parser does not scan the line a second time).
+        // The default scans the line.
+        virtual LineInfo            getLineInfo(std::string_view line) const
+        {
+            LineScanner scanner;
+            scanner.scan(line);
+            return scanner.getInfo();
+        }
         virtual void                ignore(std::size_t size)    = 0;
 
-        virtual void sendMessage(std::string const& message)    = 0;
+        // Read up to "size" bytes of a request body into "buffer".
+        // Returns the number of bytes read (0 if no more data is available).
+        virtual std::size_t readBody(char* buffer, std::size_t size)  = 0;
+        // Write the next "size" bytes of the input to the open file "fileFd".
+        // The default version copies through a fixed size buffer using readBody().
+        // Streams that wrap a plain socket can override this to use splice().
+        // Returns the number of bytes written (less than "size" if the input ended).
+        virtual std::size_t spliceTo(int fileFd, std::size_t size);
+
+        virtual void sendMessage(std::string_view message)      = 0;
         virtual void sync()                                     = 0;
 
+        // Send data that the caller guarantees stays valid until the next sync().
+        // This allows a stream to queue the data by reference rather than copy it.
+        virtual void sendReference(std::string_view message)   {sendMessage(message);}
+
+        // Send "size" bytes from the open file "fileFd" starting at "offset".
+        // The default version copies the file through sendMessage() using a
+        // fixed size buffer. Streams that wrap a plain socket can override this
+        // to let the kernel move the data directly (see sendfile()).
+        virtual void sendFileRange(int fileFd, std::size_t offset, std::size_t size);
+
+        // Called by the request pipeline when the headers of a request have been read and when
+        // the request is complete. A stream can use these to apply a different timeout while it
+        // reads a request than while it waits for the next one. The defaults do nothing.
+        virtual void headersComplete()                          {}
+        virtual void requestComplete()                          {}
+
         virtual bool hasData()  const                           = 0;
         virtual void close()                                    = 0;
 };
 
-void handleConnection(Stream& socket, std::filesystem::path const& contentDir);
+/*
+ * HttpStream: What the request pipeline (see HTTPStuff.h) needs from a stream.
+ * Stream satisfies it with virtual calls. A final class derived from Stream satisfies it
+ * with direct calls.
+ */
+template<typename S>
+concept HttpStream = requires(S& stream, S const& constStream, std::string_view text, char* buffer, std::size_t size, int fd)
+{
+    {stream.getNextLine()}                  -> std::convertible_to<std::string_view>;
+    {constStream.getLineInfo(text)}         -> std::convertible_to<LineInfo>;
+    stream.ignore(size);
+    {stream.readBody(buffer, size)}         -> std::convertible_to<std::size_t>;
+    {stream.spliceTo(fd, size)}             -> std::convertible_to<std::size_t>;
+    stream.sendMessage(text);
+    stream.sendReference(text);
+    stream.sendFileRange(fd, size, size);
+    stream.sync();
+    stream.headersComplete();
+    stream.requestComplete();
+    {constStream.hasData()}                 -> std::convertible_to<bool>;
+    stream.close();
+};
+
+class ContentStore;
+// The version of handleConnection() that uses virtual calls on the Stream.
+// Include HTTPStuff.h to get the version templated on the concrete stream type.
+void handleConnection(Stream& socket, ContentStore& contentStore);
 
 #endif
@@ -0,0 +1,383 @@
+#ifdef __linux__
+
+#include "Uring.h"
+#include "Stream.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Uring
+// =====
+Uring::Mapping::~Mapping()
+{
+    if (address != nullptr) {
+        ::munmap(address, size);
+    }
+}
+
+Uring::Uring(unsigned requested)
+    : ringFd{-1}
+    , nextTag{acceptTag + 1}
+    , acceptArmed{false}
+    , pipeFd{-1, -1}
+    , pipeSize{0}
+{
+    ::io_uring_params   params{};
+    ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, requested, &params));
+    if (ringFd == -1) {
+        throw std::runtime_error(Message{} << "Uring: io_uring_setup failed: " << errno << " " << strerror(errno));
+    }
+    try
+    {
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_NODROP) == 0) {
+            throw std::runtime_error("Uring: io_uring is too old (needs IORING_FEAT_SINGLE_MMAP and IORING_FEAT_NODROP)");
+        }
+
+        // The submission and completion rings share one mapping.
+        ringMapping.size    = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                       params.cq_off.cqes  + params.cq_entries * sizeof(::io_uring_cqe));
+        ringMapping.address = ::mmap(nullptr, ringMapping.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (ringMapping.address == MAP_FAILED) {
+            ringMapping.address = nullptr;
+            throw std::runtime_error(Message{} << "Uring: mmap ring failed: " << errno << " " << strerror(errno));
+        }
+        sqeMapping.size     = params.sq_entries * sizeof(::io_uring_sqe);
+        sqeMapping.address  = ::mmap(nullptr, sqeMapping.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqeMapping.address == MAP_FAILED) {
+            sqeMapping.address = nullptr;
+            throw std::runtime_error(Message{} << "Uring: mmap entries failed: " << errno << " " << strerror(errno));
+        }
+    }
+    catch (...)
+    {
+        ::close(ringFd);
+        throw;
+    }
+
+    char*   ring    = static_cast<char*>(ringMapping.address);
+    entries = params.sq_entries;
+    sqHead  = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    sqTail  = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    sqMask  = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    sqes    = static_cast<::io_uring_sqe*>(sqeMapping.address);
+    cqHead  = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    cqTail  = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    cqMask  = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    cqes    = reinterpret_cast<::io_uring_cqe*>(ring + params.cq_off.cqes);
+}
+
+Uring::~Uring()
+{
+    if (pipeFd[0] != -1)
+    {
+        ::close(pipeFd[0]);
+        ::close(pipeFd[1]);
+    }
+    ::close(ringFd);
+}
+
+int Uring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+void Uring::push(::io_uring_sqe const& entry)
+{
+    unsigned const  tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == entries) {
+        // The ring is full: Submit to make space.
+        enter(unsubmitted(), 0, 0);
+    }
+    unsigned const  index = tail & sqMask;
+    sqes[index]     = entry;
+    sqArray[index]  = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+unsigned Uring::unsubmitted() const
+{
+    return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+}
+
+// Blocking operations
+// ===================
+std::uint64_t Uring::queue(::io_uring_sqe entry)
+{
+    entry.user_data = nextTag++;
+    push(entry);
+    return entry.user_data;
+}
+
+Uring::Completion Uring::wait(std::uint64_t userData)
+{
+    while (true)
+    {
+        auto find = std::find_if(std::begin(early), std::end(early), [userData](Completion const& completion){return completion.userData == userData;});
+        if (find != std::end(early))
+        {
+            Completion  completion = *find;
+            early.erase(find);
+            return completion;
+        }
+
+        // Keep everything else (it is for a later wait()).
+        Completion  completion{};
+        bool        found = false;
+        reap([&](::io_uring_cqe const& entry)
+        {
+            if (!found && entry.user_data == userData)
+            {
+                completion  = {entry.user_data, entry.res, entry.flags};
+                found       = true;
+                return;
+            }
+            early.push_back({entry.user_data, entry.res, entry.flags});
+        });
+        if (found) {
+            return completion;
+        }
+        // Submit anything queued and wait for the next completion.
+        if (enter(unsubmitted(), 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            throw std::runtime_error(Message{} << "Uring: io_uring_enter failed: " << errno << " " << strerror(errno));
+        }
+    }
+}
+
+void Uring::waitAll(std::uint64_t const* tags, std::int32_t* results, std::size_t count)
+{
+    // The entries of a chain complete one after the other.
+    // Wait for all of them in one io_uring_enter() (not one for each wait()).
+    if (enter(unsubmitted(), static_cast<unsigned>(count), IORING_ENTER_GETEVENTS) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        throw std::runtime_error(Message{} << "Uring: io_uring_enter failed: " << errno << " " << strerror(errno));
+    }
+    for (std::size_t loop = 0; loop < count; ++loop) {
+        results[loop] = wait(tags[loop]).result;
+    }
+}
+
+::ssize_t Uring::result(Completion const& completion)
+{
+    if (completion.result < 0)
+    {
+        errno = -completion.result;
+        return -1;
+    }
+    return completion.result;
+}
+
+int Uring::accept(int listenFd)
+{
+    if (!acceptArmed)
+    {
+        // One submission accepts every connection until the kernel stops it (an error).
+        ::io_uring_sqe  entry{};
+        entry.opcode        = IORING_OP_ACCEPT;
+        entry.fd            = listenFd;
+        entry.ioprio        = IORING_ACCEPT_MULTISHOT;
+        entry.accept_flags  = SOCK_CLOEXEC;
+        entry.user_data     = acceptTag;
+        push(entry);
+        acceptArmed = true;
+    }
+    Completion  completion = wait(acceptTag);
+    if ((completion.flags & IORING_CQE_F_MORE) == 0) {
+        acceptArmed = false;
+    }
+    return static_cast<int>(result(completion));
+}
+
+::ssize_t Uring::recv(int fd, void* buffer, std::size_t size)
+{
+    ::io_uring_sqe  entry{};
+    entry.opcode    = IORING_OP_RECV;
+    entry.fd        = fd;
+    entry.addr      = reinterpret_cast<std::uintptr_t>(buffer);
+    entry.len       = static_cast<std::uint32_t>(std::min<std::size_t>(size, UINT32_MAX));
+    return result(wait(queue(entry)));
+}
+
+::ssize_t Uring::send(int fd, ::iovec const* iov, std::size_t count)
+{
+    ::msghdr        message{};
+    message.msg_iov     = const_cast<::iovec*>(iov);
+    message.msg_iovlen  = count;
+
+    ::io_uring_sqe  entry{};
+    entry.opcode    = IORING_OP_SENDMSG;
+    entry.fd        = fd;
+    entry.addr      = reinterpret_cast<std::uintptr_t>(&message);
+    entry.len       = 1;
+    entry.msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    return result(wait(queue(entry)));
+}
+
+bool Uring::openPipe()
+{
+    if (pipeFd[0] != -1) {
+        return true;
+    }
+    if (::pipe2(pipeFd, O_CLOEXEC) == -1)
+    {
+        pipeFd[0] = pipeFd[1] = -1;
+        return false;
+    }
+    // A larger pipe moves more of the file with each pair of splices (the default is 64K).
+    ::fcntl(pipeFd[1], F_SETPIPE_SZ, 1024 * 1024);
+    int size = ::fcntl(pipeFd[1], F_GETPIPE_SZ);
+    pipeSize = size > 0 ? size : 64 * 1024;
+    return true;
+}
+
+::ssize_t Uring::drainPipe(int fd, std::size_t size)
+{
+    // The rest of a chunk that only part of was sent to the socket.
+    while (size != 0)
+    {
+        ::io_uring_sqe  entry{};
+        entry.opcode        = IORING_OP_SPLICE;
+        entry.fd            = fd;
+        entry.off           = -1;
+        entry.splice_fd_in  = pipeFd[0];
+        entry.splice_off_in = -1;
+        entry.len           = static_cast<std::uint32_t>(size);
+        ::ssize_t sent = result(wait(queue(entry)));
+        if (sent <= 0) {
+            return -1;
+        }
+        size -= sent;
+    }
+    return 0;
+}
+
+int Uring::sendFile(int fd, ::iovec const* iov, std::size_t count, int fileFd, std::size_t offset, std::size_t size)
+{
+    if (!openPipe()) {
+        return -1;
+    }
+    std::size_t headerSize = 0;
+    for (std::size_t loop = 0; loop < count; ++loop) {
+        headerSize += iov[loop].iov_len;
+    }
+    ::msghdr        message{};
+    message.msg_iov     = const_cast<::iovec*>(iov);
+    message.msg_iovlen  = count;
+
+    // A failure part way through a chain can leave data in the pipe.
+    // That must not be sent with the next response: Use a new pipe.
+    auto fail = [&](int error)
+    {
+        ::close(pipeFd[0]);
+        ::close(pipeFd[1]);
+        pipeFd[0] = pipeFd[1] = -1;
+        errno = error;
+        return -1;
+    };
+
+    while (headerSize != 0 || size != 0)
+    {
+        // The entries of a chain must all be submitted together: Leave room for all of them.
+        std::size_t const   pairs = std::min<std::size_t>({maxSplicePairs, (entries - 1) / 2, (size + pipeSize - 1) / pipeSize});
+        std::uint64_t       tags[1 + maxSplicePairs * 2];
+        std::size_t         expected[1 + maxSplicePairs * 2];
+        std::size_t         queued = 0;
+        if (unsubmitted() + 1 + pairs * 2 > entries) {
+            enter(unsubmitted(), 0, 0);
+        }
+
+        if (headerSize != 0)
+        {
+            ::io_uring_sqe  entry{};
+            entry.opcode    = IORING_OP_SENDMSG;
+            entry.fd        = fd;
+            entry.addr      = reinterpret_cast<std::uintptr_t>(&message);
+            entry.len       = 1;
+            entry.msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            entry.flags     = pairs != 0 ? IOSQE_IO_LINK : 0;
+            expected[queued] = headerSize;
+            tags[queued++]   = queue(entry);
+        }
+        std::size_t chunkOffset = offset;
+        std::size_t left        = size;
+        for (std::size_t pair = 0; pair < pairs; ++pair)
+        {
+            std::size_t const   chunk = std::min(left, pipeSize);
+            // file => pipe
+            ::io_uring_sqe  in{};
+            in.opcode           = IORING_OP_SPLICE;
+            in.fd               = pipeFd[1];
+            in.off              = -1;
+            in.splice_fd_in     = fileFd;
+            in.splice_off_in    = chunkOffset;
+            in.len              = static_cast<std::uint32_t>(chunk);
+            in.flags            = IOSQE_IO_LINK;
+            expected[queued]     = chunk;
+            tags[queued++]       = queue(in);
+            // pipe => socket
+            ::io_uring_sqe  out{};
+            out.opcode          = IORING_OP_SPLICE;
+            out.fd              = fd;
+            out.off             = -1;
+            out.splice_fd_in    = pipeFd[0];
+            out.splice_off_in   = -1;
+            out.len             = static_cast<std::uint32_t>(chunk);
+            out.flags           = pair + 1 != pairs ? IOSQE_IO_LINK : 0;
+            expected[queued]     = chunk;
+            tags[queued++]       = queue(out);
+
+            chunkOffset += chunk;
+            left        -= chunk;
+        }
+
+        // Every entry completes (the ones after a failure with -ECANCELED).
+        std::int32_t    results[1 + maxSplicePairs * 2];
+        waitAll(tags, results, queued);
+
+        std::size_t next = 0;
+        if (headerSize != 0)
+        {
+            if (results[next] < 0) {
+                return fail(-results[next]);
+            }
+            if (static_cast<std::size_t>(results[next]) != headerSize) {
+                return fail(ECONNRESET);    // MSG_WAITALL: Only short if the connection failed.
+            }
+            headerSize = 0;
+            ++next;
+        }
+        for (; next < queued; next += 2)
+        {
+            std::int32_t const  in  = results[next];
+            std::int32_t const  out = results[next + 1];
+            if (in < 0) {
+                return fail(-in);
+            }
+            if (in == 0) {
+                return fail(ENODATA);       // The file is shorter than expected.
+            }
+            offset  += in;
+            size    -= in;
+            if (out < 0 && out != -ECANCELED) {
+                return fail(-out);
+            }
+            std::size_t const   sent = out < 0 ? 0 : out;
+            if (sent != static_cast<std::size_t>(in) && drainPipe(fd, in - sent) == -1) {
+                return fail(errno);
+            }
+            if (static_cast<std::size_t>(in) != expected[next] || sent != static_cast<std::size_t>(in)) {
+                break;                      // The rest of the chain was cancelled: Start a new one.
+            }
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+ * Uring:   An io_uring instance (Linux 5.19+). Uses the raw system calls (no liburing).
+ *
+ * The low level interface (push(), enter(), reap()) is what the V5 EventHandler uses to drive
+ * its own event loop. The caller guards it if several threads use it.
+ *
+ * The blocking operations below are what a Socket uses (see Socket.h). Each one queues its
+ * entries, submits them and waits for their completions in a single io_uring_enter(). They
+ * return the same as the system call they replace (-1 with errno set on failure).
+ * Completions that arrive for something else (a connection accepted while a request was being
+ * read) are kept until they are asked for. These are for one thread.
+ *
+ *      accept()    A multishot accept: One submission accepts every connection on the listening
+ *                  socket. So once it is armed accepting a connection that is already waiting
+ *                  costs no system call at all.
+ *      recv()      A read that waits for data inside the kernel. A read that would block is one
+ *                  system call rather than read(), poll(), read().
+ *      send()      A writev() (as a sendmsg()).
+ *      sendFile()  The buffered headers then the file content, as linked entries: The send,
+ *                  then pairs of splice() file => pipe => socket. So a whole response goes out in
+ *                  one io_uring_enter() (writev() and sendfile() before).
+ *
+ * Note: The descriptors used with recv(), send() and sendFile() should be blocking: A splice()
+ *       to a non blocking socket can fail with EAGAIN.
+ */
+
+#ifdef __linux__
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+class Uring
+{
+    struct Mapping
+    {
+        void*       address = nullptr;
+        std::size_t size    = 0;
+        ~Mapping();
+    };
+    struct Completion
+    {
+        std::uint64_t   userData;
+        std::int32_t    result;
+        std::uint32_t   flags;
+    };
+
+    static constexpr std::uint64_t  acceptTag       = 1;
+    static constexpr std::size_t    maxSplicePairs  = 32;       // Per submission.
+
+    int                             ringFd;
+    unsigned                        entries;
+    Mapping                         ringMapping;
+    Mapping                         sqeMapping;
+    // Submission ring.
+    unsigned*                       sqHead;
+    unsigned*                       sqTail;
+    unsigned                        sqMask;
+    unsigned*                       sqArray;
+    ::io_uring_sqe*                 sqes;
+    // Completion ring.
+    unsigned*                       cqHead;
+    unsigned*                       cqTail;
+    unsigned                        cqMask;
+    ::io_uring_cqe*                 cqes;
+
+    // The blocking operations.
+    std::uint64_t                   nextTag;
+    std::vector<Completion>         early;          // Reaped before they were asked for.
+    bool                            acceptArmed;
+    int                             pipeFd[2];      // sendFile(): Created when first used.
+    std::size_t                     pipeSize;
+
+    public:
+        explicit Uring(unsigned entries = 256);
+        ~Uring();
+
+        Uring(Uring const&)                 = delete;
+        Uring(Uring&&)                      = delete;
+        Uring& operator=(Uring const&)      = delete;
+        Uring& operator=(Uring&&)           = delete;
+
+        // Low level.
+        // Queue an entry (if the submission ring is full what is on it is submitted first).
+        void            push(::io_uring_sqe const& entry);
+        unsigned        unsubmitted() const;
+        int             enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+        // Call "action" for each completion on the ring (up to "max"). Returns the number seen.
+        template<typename Action>
+        unsigned        reap(Action&& action, unsigned max = ~0U);
+
+        // Blocking operations.
+        int             accept(int listenFd);
+        ::ssize_t       recv(int fd, void* buffer, std::size_t size);
+        ::ssize_t       send(int fd, ::iovec const* iov, std::size_t count);
+        // Returns 0 when everything was sent.
+        int             sendFile(int fd, ::iovec const* iov, std::size_t count, int fileFd, std::size_t offset, std::size_t size);
+
+    private:
+        std::uint64_t   queue(::io_uring_sqe entry);
+        Completion      wait(std::uint64_t userData);
+        void            waitAll(std::uint64_t const* tags, std::int32_t* results, std::size_t count);
+        ::ssize_t       result(Completion const& completion);
+        bool            openPipe();
+        ::ssize_t       drainPipe(int fd, std::size_t size);
+};
+
+template<typename Action>
+unsigned Uring::reap(Action&& action, unsigned max)
+{
+    unsigned        count   = 0;
+    unsigned        head    = *cqHead;
+    unsigned const  tail    = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail && count < max; ++head, ++count) {
+        action(cqes[head & cqMask]);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+#endif
+#endif
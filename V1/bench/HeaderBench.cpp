@@ -0,0 +1,183 @@
+#include "../Socket.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Input buffering for requests with 50 headers: make bench (or bench/HeaderBench [<requests>]).
+ *
+ * cursor:      Socket::getNextLine(). Consuming a line moves a cursor. The data is only
+ *              moved to the front of the buffer when there is no space left at the end.
+ * memmove:     The Socket input buffer from before (copied below). Every line is removed by
+ *              moving the rest of the buffer to the front and lines are found with find("\r\n").
+ *
+ * Another thread writes pipelined requests to a socketpair. Both read every line of every request.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr std::size_t    headerCount = 50;
+
+class BaselineSocket
+{
+    static constexpr std::size_t    inputBufferGrowth = 500;
+    int                 fd;
+    std::vector<char>   buffer;
+    std::string_view    currentLine;
+    bool                readAvail;
+    public:
+        BaselineSocket(int fd)
+            : fd{fd}
+            , readAvail{true}
+        {
+            buffer.reserve(1000);
+        }
+        std::string_view getNextLine()
+        {
+            removeCurrentLine();
+
+            if (checkLineInBuffer()) {
+                return currentLine;
+            }
+
+            while (readAvail)
+            {
+                readMoreData(inputBufferGrowth);
+                if (checkLineInBuffer()) {
+                    return currentLine;
+                }
+            }
+
+            currentLine = {std::begin(buffer), std::end(buffer)};
+            return currentLine;
+        }
+    private:
+        void removeCurrentLine()
+        {
+            if (std::size(currentLine) == std::size(buffer)) {
+                buffer.clear();
+            }
+            else {
+                std::move(std::begin(buffer) + std::size(currentLine), std::end(buffer), std::begin(buffer));
+                buffer.resize(std::size(buffer) - std::size(currentLine));
+            }
+        }
+        bool checkLineInBuffer()
+        {
+            std::string_view bufferView{std::begin(buffer), std::end(buffer)};
+            std::size_t find = bufferView.find("\r\n");
+            if (find != std::string_view::npos) {
+                currentLine = {std::begin(buffer), std::begin(buffer) + find + 2};
+                return true;
+            }
+            return false;
+        }
+        void readMoreData(std::size_t maxSize)
+        {
+            std::size_t     currentSize = std::size(buffer);
+            buffer.resize(currentSize + maxSize);
+            ::ssize_t       nextChunk;
+            do {
+                nextChunk = ::read(fd, &buffer[0] + currentSize, maxSize);
+            } while (nextChunk == -1 && errno == EINTR);
+            if (nextChunk == -1) {
+                throw std::runtime_error("read failed");
+            }
+            if (nextChunk == 0) {
+                readAvail = false;
+            }
+            buffer.resize(currentSize + nextChunk);
+        }
+};
+
+std::string makeRequest()
+{
+    std::string request = "GET /index.html HTTP/1.1\r\n";
+    for (std::size_t loop = 0; loop < headerCount; ++loop) {
+        request += "x-header-" + std::to_string(loop) + ": some typical header value of moderate length\r\n";
+    }
+    request += "\r\n";
+    return request;
+}
+
+// Reads "requests" requests from "socket" while another thread writes them to the other end.
+template<typename S>
+void bench(char const* name, std::size_t requests, bool nonBlocking)
+{
+    static std::string const    request = makeRequest();
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cerr << "socketpair failed\n";
+        std::exit(1);
+    }
+    if (nonBlocking) {
+        ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    }
+    int         client = fds[1];
+    std::thread writer([client, requests]()
+    {
+        // Pipelined: As many requests in each write as fit in 64K.
+        std::string block;
+        for (std::size_t loop = 0; loop < 64 * 1024 / std::size(request); ++loop) {
+            block += request;
+        }
+        std::size_t const   perBlock = std::size(block) / std::size(request);
+        for (std::size_t sent = 0; sent < requests; sent += perBlock)
+        {
+            std::string_view    data{block.data(), std::min(perBlock, requests - sent) * std::size(request)};
+            while (!data.empty())
+            {
+                ::ssize_t   size = ::write(client, std::data(data), std::size(data));
+                if (size <= 0) {
+                    return;
+                }
+                data.remove_prefix(size);
+            }
+        }
+    });
+
+    std::size_t         lines   = 0;
+    Clock::time_point   start   = Clock::now();
+    {
+        S               socket(fds[0]);
+        for (std::size_t loop = 0; loop < requests; ++loop)
+        {
+            while (socket.getNextLine() != "\r\n") {
+                ++lines;
+            }
+        }
+    }
+    double const        time    = std::chrono::duration<double>(Clock::now() - start).count();
+    writer.join();
+    ::close(client);
+    if (!nonBlocking) {
+        ::close(fds[0]);
+    }
+    if (lines != requests * (headerCount + 1)) {
+        std::cerr << name << ": Wrong line count\n";
+        std::exit(1);
+    }
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << requests / time / 1'000'000 << " Mrequests/s"
+              << std::setw(10) << std::size(request) * requests / time / (1024 * 1024) << " MB/s\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200'000;
+    bench<Socket>("cursor", requests, true);
+    bench<BaselineSocket>("memmove", requests, false);
+}
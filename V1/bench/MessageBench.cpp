@@ -0,0 +1,74 @@
+#include "../Stream.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdlib>
+
+/*
+ * Message formatting: make bench (or bench/MessageBench [<messages>]).
+ *
+ * Message:         The inline buffer formatter (std::to_chars for numbers).
+ * stringstream:    The Message from before (copied below): A std::stringstream for each
+ *                  message and a std::string made from it (sendMessage() took a std::string).
+ *
+ * Both build the headers of a 206 response (text and numbers), the most formatting any response does.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+class StreamMessage
+{
+    std::stringstream   ss;
+    public:
+        template<typename T>
+        StreamMessage& operator<<(T const& data) {ss << data;return *this;}
+
+        operator std::string() {return ss.str();}
+};
+
+// Build the headers for message "loop". Returns the length of the text built.
+std::size_t format(Message&& message, std::size_t loop)
+{
+    message << "HTTP/1.1 206 Partial Content\r\n"
+            << "content-length: " << loop << "\r\n"
+            << "content-range: bytes " << loop << "-" << loop * 2 << "/" << loop * 3 << "\r\n"
+            << "last-modified: " << 1700000000 + loop << "\r\n";
+    return std::size(message.view());
+}
+
+std::size_t format(StreamMessage&& message, std::size_t loop)
+{
+    message << "HTTP/1.1 206 Partial Content\r\n"
+            << "content-length: " << loop << "\r\n"
+            << "content-range: bytes " << loop << "-" << loop * 2 << "/" << loop * 3 << "\r\n"
+            << "last-modified: " << 1700000000 + loop << "\r\n";
+    return std::size(static_cast<std::string>(message));
+}
+
+template<typename M>
+void bench(char const* name, std::size_t messages)
+{
+    std::size_t         total   = 0;
+    Clock::time_point   start   = Clock::now();
+    for (std::size_t loop = 0; loop < messages; ++loop) {
+        total += format(M{}, loop);
+    }
+    double const        time    = std::chrono::duration<double>(Clock::now() - start).count();
+    if (total == 0) {
+        std::exit(1);
+    }
+    std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << messages / time / 1'000'000 << " Mmessages/s"
+              << std::setw(10) << time * 1'000'000'000 / messages << " ns/message\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2'000'000;
+    bench<Message>("Message", messages);
+    bench<StreamMessage>("stringstream", messages);
+}
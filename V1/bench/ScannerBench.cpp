@@ -0,0 +1,141 @@
+#include "../Socket.h"
+#include "../Scanner.h"
+#include "../HTTPStuff.h"
+#include "../Logger.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Request parsing throughput: make bench (or bench/ScannerBench [<requests>]).
+ *
+ * findAny:     Bytes searched per second (a buffer with no match: The vector loop only).
+ * LineScanner: Lines per second found in a typical request.
+ * HttpRequest: Requests per second parsed from a Socket. Another thread writes pipelined
+ *              requests to a socketpair. So this is the Socket input buffering, the line
+ *              scanner and the request parsing together.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static std::string const request    = "GET /index.html HTTP/1.1\r\n"
+                                      "host: localhost:8080\r\n"
+                                      "user-agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+                                      "accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+                                      "accept-language: en-US,en;q=0.5\r\n"
+                                      "accept-encoding: gzip, deflate, br\r\n"
+                                      "connection: keep-alive\r\n"
+                                      "\r\n";
+
+double seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(char const* name, double count, char const* unit, double time)
+{
+    std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << count / time / 1'000'000 << " M" << unit << "/s\n";
+}
+
+void benchFindAny(std::size_t requests)
+{
+    std::string const   data(64 * 1024, 'x');
+    std::size_t const   loops   = requests / 16 + 1;
+    std::size_t         found   = 0;
+    Clock::time_point   start   = Clock::now();
+    for (std::size_t loop = 0; loop < loops; ++loop) {
+        found += findAny(std::data(data), std::size(data), '\n', ':', ' ');
+    }
+    double const        time    = seconds(start);
+    if (found != loops * std::size(data)) {
+        std::cerr << "findAny: Wrong result\n";
+        std::exit(1);
+    }
+    report("findAny", static_cast<double>(loops * std::size(data)), "B", time);
+}
+
+void benchLineScanner(std::size_t requests)
+{
+    std::size_t         lines   = 0;
+    Clock::time_point   start   = Clock::now();
+    for (std::size_t loop = 0; loop < requests; ++loop)
+    {
+        std::string_view    data = request;
+        LineScanner         scanner;
+        while (!data.empty() && scanner.scan(data))
+        {
+            data.remove_prefix(scanner.getInfo().lineEnd);
+            scanner.reset();
+            ++lines;
+        }
+    }
+    report("LineScanner", static_cast<double>(lines), "lines", seconds(start));
+}
+
+void benchHttpRequest(std::size_t requests)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cerr << "socketpair failed\n";
+        std::exit(1);
+    }
+    // Only the server end is non blocking (the writer simply blocks when it gets ahead).
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    Socket      socket(fds[0]);
+    int         client = fds[1];
+    std::thread writer([client, requests]()
+    {
+        // Pipelined: As many requests in each write as fit in 64K.
+        std::string block;
+        for (std::size_t loop = 0; loop < 64 * 1024 / std::size(request); ++loop) {
+            block += request;
+        }
+        std::size_t const   perBlock = std::size(block) / std::size(request);
+        for (std::size_t sent = 0; sent < requests; sent += perBlock)
+        {
+            std::string_view    data{block.data(), std::min(perBlock, requests - sent) * std::size(request)};
+            while (!data.empty())
+            {
+                ::ssize_t   size = ::write(client, std::data(data), std::size(data));
+                if (size <= 0) {
+                    return;
+                }
+                data.remove_prefix(size);
+            }
+        }
+    });
+
+    Clock::time_point   start   = Clock::now();
+    for (std::size_t loop = 0; loop < requests; ++loop)
+    {
+        HttpRequest     httpRequest(socket);
+        if (!httpRequest.isValid()) {
+            std::cerr << "HttpRequest: Invalid request\n";
+            std::exit(1);
+        }
+    }
+    double const        time    = seconds(start);
+    writer.join();
+    ::close(client);
+    report("HttpRequest", static_cast<double>(requests), "requests", time);
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1'000'000;
+    // Each request is still logged (the cost is part of parsing) but not written anywhere.
+    Logger::instance().setOutput("/dev/null");
+    benchFindAny(requests);
+    benchLineScanner(requests);
+    benchHttpRequest(requests);
+}
@@ -0,0 +1,122 @@
+#include "../Socket.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * File body throughput: make bench (or bench/SendBench [<repeat>]).
+ *
+ * sendfile:    Socket::sendFileRange() (sendfile() on Linux).
+ * copy:        The generic Stream::sendFileRange() (read into a buffer then write).
+ * getline:     The loop HttpResponse::send() used before: std::getline() over a std::ifstream
+ *              and sendMessage() for each line.
+ *
+ * The file is text (80 byte lines) so the getline loop sends the same bytes.
+ * Another thread reads (and discards) everything from the other end of a socketpair.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr std::size_t    fileSize    = 8 * 1024 * 1024;
+static constexpr std::size_t    lineSize    = 80;
+
+void fail(char const* message)
+{
+    std::cerr << message << "\n";
+    std::exit(1);
+}
+
+// Runs "send" against a Socket and reports the rate the other end received the data.
+void bench(char const* name, std::function<void(Socket&)> const& send)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        fail("socketpair failed");
+    }
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    int         client      = fds[1];
+    std::size_t received    = 0;
+    std::thread reader([client, &received]()
+    {
+        std::vector<char>   buffer(256 * 1024);
+        while (::ssize_t size = ::read(client, std::data(buffer), std::size(buffer)))
+        {
+            if (size == -1) {
+                break;
+            }
+            received += size;
+        }
+    });
+
+    Clock::time_point   start = Clock::now();
+    {
+        Socket  socket(fds[0]);
+        send(socket);
+        socket.sync();
+    }
+    reader.join();
+    double const        time = std::chrono::duration<double>(Clock::now() - start).count();
+    ::close(client);
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << received / time / (1024 * 1024) << " MB/s\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   repeat = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+
+    char    fileName[] = "/tmp/SendBenchXXXXXX";
+    int     fileFd = ::mkstemp(fileName);
+    if (fileFd == -1) {
+        fail("mkstemp failed");
+    }
+    std::string         content;
+    while (std::size(content) < fileSize) {
+        content += std::string(lineSize - 1, 'x') + "\n";
+    }
+    content.resize(fileSize);
+    if (::write(fileFd, std::data(content), std::size(content)) != static_cast<::ssize_t>(fileSize)) {
+        fail("Failed to write the file");
+    }
+
+    bench("sendfile", [&](Socket& socket)
+    {
+        for (std::size_t loop = 0; loop < repeat; ++loop) {
+            socket.sendFileRange(fileFd, 0, fileSize);
+        }
+    });
+    bench("copy", [&](Socket& socket)
+    {
+        for (std::size_t loop = 0; loop < repeat; ++loop) {
+            socket.Stream::sendFileRange(fileFd, 0, fileSize);
+        }
+    });
+    bench("getline", [&](Socket& socket)
+    {
+        for (std::size_t loop = 0; loop < repeat; ++loop)
+        {
+            std::ifstream   file(fileName);
+            std::string     line;
+            while (std::getline(file, line)) {
+                socket.sendMessage(line);
+                if (file) {
+                    socket.sendMessage("\n");
+                }
+            }
+            socket.sync();
+        }
+    });
+    ::unlink(fileName);
+    ::close(fileFd);
+}
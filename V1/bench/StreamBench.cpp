@@ -0,0 +1,113 @@
+#include "../HTTPStuff.h"
+#include "../ContentStore.h"
+#include "../Logger.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+
+/*
+ * The request pipeline through Stream or a final class: make bench (or bench/StreamBench [<requests>]).
+ *
+ * template:    handleConnection(MemoryStream&, ...): Every stream call is a direct call.
+ * virtual:     handleConnection(Stream&, ...): The same stream through the virtual interface.
+ *
+ * MemoryStream holds the pipelined requests in memory and discards the responses. So there are
+ * no system calls and the time is the request parsing, the content lookup and the calls on the
+ * stream. The requests are for a small file (served from the response cache).
+ */
+
+using Clock = std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+class MemoryStream final: public Stream
+{
+    std::string_view    input;
+    std::string_view    currentLine;
+    LineScanner         lineScanner;
+    std::size_t         written;
+    public:
+        MemoryStream(std::string_view input)
+            : input{input}
+            , written{0}
+        {}
+        std::size_t getWritten() const  {return written;}
+
+        std::string_view    getNextLine()   override
+        {
+            input.remove_prefix(std::size(currentLine));
+            lineScanner.reset();
+            currentLine = lineScanner.scan(input) ? input.substr(0, lineScanner.getInfo().lineEnd) : input;
+            return currentLine;
+        }
+        LineInfo getLineInfo(std::string_view) const override {return lineScanner.getInfo();}
+        void ignore(std::size_t size)       override
+        {
+            readBody(nullptr, size);
+        }
+        std::size_t readBody(char*, std::size_t size)       override
+        {
+            input.remove_prefix(std::size(currentLine));
+            currentLine = "";
+            size = std::min(size, std::size(input));
+            input.remove_prefix(size);
+            return size;
+        }
+        std::size_t spliceTo(int, std::size_t size)         override {return readBody(nullptr, size);}
+
+        void sendMessage(std::string_view message)      override {written += std::size(message);}
+        void sync()                                     override {}
+        void sendFileRange(int, std::size_t, std::size_t size) override {written += size;}
+
+        bool hasData()  const   override {return std::size(input) != std::size(currentLine);}
+        void close()            override {input = "";currentLine = "";}
+};
+
+template<typename S>
+void bench(char const* name, std::string const& requests, std::size_t count, ContentStore& store)
+{
+    MemoryStream        stream(requests);
+    Clock::time_point   start   = Clock::now();
+    handleConnection(static_cast<S&>(stream), store);
+    double const        time    = std::chrono::duration<double>(Clock::now() - start).count();
+    if (stream.getWritten() == 0) {
+        std::exit(1);
+    }
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << count / time / 1'000'000 << " Mrequests/s"
+              << std::setw(10) << time * 1'000'000'000 / count << " ns/request\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500'000;
+    // Each request is still logged (the cost is part of the request) but not written anywhere.
+    Logger::instance().setOutput("/dev/null");
+
+    fs::path const      contentDir = fs::temp_directory_path() / ("StreamBench." + std::to_string(::getpid()));
+    fs::create_directories(contentDir);
+    std::ofstream(contentDir / "index.html") << std::string(512, 'x');
+
+    std::string const   request = "GET /index.html HTTP/1.1\r\n"
+                                  "host: localhost:8080\r\n"
+                                  "accept: text/html\r\n"
+                                  "connection: keep-alive\r\n"
+                                  "\r\n";
+    std::string         requests;
+    for (std::size_t loop = 0; loop < count; ++loop) {
+        requests += request;
+    }
+    {
+        ContentStore    store(contentDir);
+        bench<MemoryStream>("template", requests, count, store);
+        bench<Stream>("virtual", requests, count, store);
+    }
+    fs::remove_all(contentDir);
+}
@@ -0,0 +1,213 @@
+#include "../Socket.h"
+#include "../Uring.h"
+#include "../HTTPStuff.h"
+#include "../ContentStore.h"
+#include "../Logger.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/*
+ * System calls per request: make bench (or bench/SyscallBench [<requests>]). Linux only.
+ *
+ * plain:   The Socket as NisseV1 uses it: A non blocking descriptor with read(), writev()
+ *          and sendfile() (and poll() when it would block).
+ * uring:   The Socket with a Uring (NisseV1 -u): A multishot accept, then recv, sendmsg and
+ *          linked sendmsg/splice entries through the ring. Each one is a single io_uring_enter().
+ *
+ * The server is a child process that serves one keep-alive connection with handleConnection().
+ * It is traced with ptrace(PTRACE_SYSCALL) (this is what strace -c does) and every system call
+ * its thread makes is counted (from the accept until the client closes the connection).
+ * The client sends one request and reads the whole response before sending the next (no
+ * pipelining). With "pause" it then waits 50us (as a real client would not have the next request
+ * ready at once). Without it (on one core) the next request is usually there before the server
+ * reads again: So the server rarely has to wait.
+ *
+ * small:   A 512 byte file (served from the response cache).
+ * large:   A 1MB file (sendfile() or splice()).
+ *
+ * The time is from a second run that is not traced (ptrace makes every system call slow).
+ */
+
+using Clock = std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+void fail(char const* message)
+{
+    std::cerr << message << "\n";
+    std::exit(1);
+}
+
+// Send "count" requests for "path" one at a time. Reading each response completely.
+void client(int port, std::string const& path, std::size_t count, bool pause)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::sockaddr_in   address{};
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<::sockaddr*>(&address), sizeof(address)) != 0) {
+        fail("connect failed");
+    }
+    std::string const   request = "GET " + path + " HTTP/1.1\r\nhost: localhost\r\nconnection: keep-alive\r\n\r\n";
+    std::vector<char>   buffer(256 * 1024);
+    for (std::size_t loop = 0; loop < count; ++loop)
+    {
+        if (pause) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        if (::write(fd, std::data(request), std::size(request)) != static_cast<::ssize_t>(std::size(request))) {
+            fail("request write failed");
+        }
+        // Read the headers. Then the body (content-length).
+        std::string     headers;
+        std::size_t     headerEnd;
+        while ((headerEnd = headers.find("\r\n\r\n")) == std::string::npos)
+        {
+            ::ssize_t size = ::read(fd, std::data(buffer), 1024);
+            if (size <= 0) {
+                fail("response read failed");
+            }
+            headers.append(std::data(buffer), size);
+        }
+        std::size_t     lengthPos = headers.find("content-length: ");
+        if (lengthPos == std::string::npos) {
+            fail("no content-length");
+        }
+        std::size_t     left = std::strtoul(std::data(headers) + lengthPos + 16, nullptr, 10) - (std::size(headers) - headerEnd - 4);
+        while (left != 0)
+        {
+            ::ssize_t size = ::read(fd, std::data(buffer), std::min(left, std::size(buffer)));
+            if (size <= 0) {
+                fail("body read failed");
+            }
+            left -= size;
+        }
+    }
+    ::close(fd);
+}
+
+// Serve one connection in a child process.
+// Returns the number of system calls the server made (if traced).
+std::size_t serve(int listenFd, fs::path const& contentDir, bool useRing, bool traced, std::string const& path, std::size_t count, bool pause)
+{
+    sockaddr_in address{};
+    ::socklen_t size = sizeof(address);
+    ::getsockname(listenFd, reinterpret_cast<::sockaddr*>(&address), &size);
+
+    ::pid_t child = ::fork();
+    if (child == -1) {
+        fail("fork failed");
+    }
+    if (child == 0)
+    {
+        Logger::instance().setOutput("/dev/null");
+        ContentStore            store(contentDir);
+        std::unique_ptr<Uring>  ring;
+        if (useRing) {
+            ring = std::make_unique<Uring>();
+        }
+        if (traced)
+        {
+            // Stops here until the parent is ready to trace.
+            ::ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+            ::raise(SIGSTOP);
+        }
+        {
+            int fd = ring ? ring->accept(listenFd) : ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd == -1) {
+                std::_Exit(1);
+            }
+            Socket  socket(fd, ring.get());
+            handleConnection(socket, store);
+        }
+        std::_Exit(0);
+    }
+
+    std::thread     requests(client, ntohs(address.sin_port), path, count, pause);
+    std::size_t     stops = 0;
+    int             status;
+    if (traced)
+    {
+        ::waitpid(child, &status, 0);
+        ::ptrace(PTRACE_SETOPTIONS, child, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+        ::ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+        while (::waitpid(child, &status, 0) == child && WIFSTOPPED(status))
+        {
+            int signal = 0;
+            if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+                ++stops;            // Each system call stops twice (entry and exit).
+            }
+            else {
+                signal = WSTOPSIG(status);
+            }
+            ::ptrace(PTRACE_SYSCALL, child, nullptr, signal);
+        }
+    }
+    requests.join();
+    if (!traced) {
+        ::waitpid(child, &status, 0);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fail("server failed");
+    }
+    return (stops + 1) / 2;
+}
+
+void bench(char const* name, int listenFd, fs::path const& contentDir, bool useRing, std::string const& path, std::size_t count, bool pause)
+{
+    std::size_t const   syscalls = serve(listenFd, contentDir, useRing, true, path, count, pause);
+
+    Clock::time_point   start   = Clock::now();
+    serve(listenFd, contentDir, useRing, false, path, count, pause);
+    double const        time    = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << static_cast<double>(syscalls) / count << " syscalls/request"
+              << std::setw(10) << time * 1'000'000 / count << " us/request\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2'000;
+
+    fs::path const      contentDir = fs::temp_directory_path() / ("SyscallBench." + std::to_string(::getpid()));
+    fs::create_directories(contentDir);
+    std::ofstream(contentDir / "small.html") << std::string(512, 'x');
+    std::ofstream(contentDir / "large.bin")  << std::string(1024 * 1024, 'x');
+
+    int listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::sockaddr_in   address{};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(listenFd, reinterpret_cast<::sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listenFd, 16) != 0) {
+        fail("listen failed");
+    }
+
+    bench("plain small",        listenFd, contentDir, false, "/small.html", count,      false);
+    bench("uring small",        listenFd, contentDir, true,  "/small.html", count,      false);
+    bench("plain small pause",  listenFd, contentDir, false, "/small.html", count,      true);
+    bench("uring small pause",  listenFd, contentDir, true,  "/small.html", count,      true);
+    bench("plain large",        listenFd, contentDir, false, "/large.bin",  count / 10, false);
+    bench("uring large",        listenFd, contentDir, true,  "/large.bin",  count / 10, false);
+
+    ::close(listenFd);
+    fs::remove_all(contentDir);
+}
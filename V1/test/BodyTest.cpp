@@ -0,0 +1,70 @@
+#include "../Socket.h"
+#include "../HTTPStuff.h"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Read a request body to the end (the normal "read until 0" loop) then send a second
+ * request on the same connection. The connection must still be usable.
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+void send(int fd, std::string_view data)
+{
+    CHECK(::write(fd, std::data(data), std::size(data)) == static_cast<::ssize_t>(std::size(data)));
+}
+
+void readBodyThenNextRequest(std::size_t chunkSize)
+{
+    int fds[2];
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+    Socket  socket(fds[0]);
+    int     client = fds[1];
+
+    send(client, "GET /one HTTP/1.1\r\ncontent-length: 11\r\n\r\nhello world");
+    HttpRequest first(socket);
+    CHECK(first.isValid());
+    CHECK(first.getBodySize() == 11);
+
+    std::string body;
+    char        buffer[16];
+    while (std::size_t size = first.readBody(socket, buffer, chunkSize)) {
+        body.append(buffer, size);
+    }
+    CHECK(body == "hello world");
+    CHECK(first.getBodyRemaining() == 0);
+    // Reading past the end (or reading nothing) must not touch the connection.
+    CHECK(first.readBody(socket, buffer, sizeof(buffer)) == 0);
+    CHECK(socket.readBody(buffer, 0) == 0);
+    first.discardBody(socket);
+
+    // The second request is only sent once the first body has been read.
+    send(client, "GET /two HTTP/1.1\r\n\r\n");
+    CHECK(socket.hasData());
+    HttpRequest second(socket);
+    CHECK(second.isValid());
+    CHECK(second.getURI() == "two");      // The leading "/" is not part of the URI.
+
+    ::close(client);
+}
+
+int main()
+{
+    readBodyThenNextRequest(4);     // Several reads.
+    readBodyThenNextRequest(11);    // Exactly the body.
+    readBodyThenNextRequest(16);    // More than the body.
+    std::cout << "BodyTest: OK\n";
+}
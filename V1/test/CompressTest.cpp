@@ -0,0 +1,125 @@
+#include "../Socket.h"
+#include "../HTTPStuff.h"
+#include "../ContentStore.h"
+#include "../Logger.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/*
+ * Compression on demand (ContentConfig::compressOnDemand, NisseV1 -z):
+ *      A client that accepts gzip gets the gzipped file with "content-encoding: gzip".
+ *      A client that does not gets the file as it is.
+ *      Both get "vary: accept-encoding" (a cache must not give one the other's response).
+ *      With compressOnDemand off neither header is sent.
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+namespace fs = std::filesystem;
+
+struct Response
+{
+    std::string headers;
+    std::string body;
+    bool has(std::string_view header) const {return headers.find(header) != std::string::npos;}
+};
+
+Response get(ContentStore& store, std::string_view acceptEncoding)
+{
+    int fds[2];
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+    Socket  socket(fds[0]);
+    int     client = fds[1];
+
+    std::string request = "GET /page.html HTTP/1.1\r\nhost: localhost\r\n";
+    if (!acceptEncoding.empty()) {
+        request += "accept-encoding: " + std::string(acceptEncoding) + "\r\n";
+    }
+    request += "\r\n";
+    CHECK(::write(client, std::data(request), std::size(request)) == static_cast<::ssize_t>(std::size(request)));
+    CHECK(handleRequest(socket, store));
+    socket.sync();
+
+    // The response is small enough to be waiting in the socket buffer.
+    std::string response;
+    char        buffer[4096];
+    ::ssize_t   size;
+    while ((size = ::read(client, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, size);
+    }
+    ::close(client);
+
+    std::size_t headerEnd = response.find("\r\n\r\n");
+    CHECK(headerEnd != std::string::npos);
+    return {response.substr(0, headerEnd + 2), response.substr(headerEnd + 4)};
+}
+
+std::string gunzip(std::string const& data)
+{
+    ::z_stream  stream{};
+    CHECK(::inflateInit2(&stream, 15 + 16) == Z_OK);
+    std::string result(64 * 1024, '\0');
+    stream.next_in      = reinterpret_cast<Bytef*>(const_cast<char*>(std::data(data)));
+    stream.avail_in     = static_cast<uInt>(std::size(data));
+    stream.next_out     = reinterpret_cast<Bytef*>(std::data(result));
+    stream.avail_out    = static_cast<uInt>(std::size(result));
+    CHECK(::inflate(&stream, Z_FINISH) == Z_STREAM_END);
+    result.resize(stream.total_out);
+    ::inflateEnd(&stream);
+    return result;
+}
+
+int main()
+{
+    Logger::instance().setOutput("/dev/null");
+
+    fs::path const      contentDir = fs::temp_directory_path() / ("CompressTest." + std::to_string(::getpid()));
+    fs::create_directories(contentDir);
+    std::string         page;
+    while (std::size(page) < 8000) {
+        page += "<p>Some text that compresses well because it repeats.</p>\n";
+    }
+    std::ofstream(contentDir / "page.html") << page;
+
+    {
+        ContentConfig   config;
+        config.compressOnDemand = true;
+        ContentStore    store(contentDir, config);
+
+        Response        gzipped = get(store, "gzip, deflate");
+        CHECK(gzipped.has("content-encoding: gzip\r\n"));
+        CHECK(gzipped.has("vary: accept-encoding\r\n"));
+        CHECK(std::size(gzipped.body) < std::size(page));
+        CHECK(gunzip(gzipped.body) == page);
+
+        Response        plain = get(store, "");
+        CHECK(!plain.has("content-encoding:"));
+        CHECK(plain.has("vary: accept-encoding\r\n"));
+        CHECK(plain.body == page);
+    }
+    {
+        ContentStore    store(contentDir);
+        Response        plain = get(store, "gzip");
+        CHECK(!plain.has("content-encoding:"));
+        CHECK(!plain.has("vary:"));
+        CHECK(plain.body == page);
+    }
+
+    fs::remove_all(contentDir);
+    std::cout << "CompressTest: OK\n";
+}
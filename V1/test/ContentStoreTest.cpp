@@ -0,0 +1,75 @@
+#include "../ContentStore.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <cstdlib>
+
+#include <unistd.h>
+
+/*
+ * The descriptor budget (ContentConfig::maxOpenFiles):
+ *      The pre-compressed variants (".gz" and ".br") count against it as well as the file.
+ *      The file is kept open first, then its variants with whatever is left.
+ *      Once it is used entries are cached without descriptors (but still found).
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+namespace fs = std::filesystem;
+
+std::size_t openDescriptors()
+{
+    std::size_t result = 0;
+    for ([[maybe_unused]] auto const& entry: fs::directory_iterator("/proc/self/fd")) {
+        ++result;
+    }
+    return result;
+}
+
+std::size_t descriptors(FileInfo const& file)
+{
+    return (file.fd != -1) + (file.gzip && file.gzip->fd != -1) + (file.brotli && file.brotli->fd != -1);
+}
+
+int main()
+{
+    fs::path const      contentDir = fs::temp_directory_path() / ("ContentStoreTest." + std::to_string(::getpid()));
+    fs::create_directories(contentDir);
+    for (char const* name: {"one.html", "two.html", "three.html"})
+    {
+        std::ofstream(contentDir / name) << name;
+        std::ofstream(contentDir / (std::string(name) + ".gz")) << "gzip";
+        std::ofstream(contentDir / (std::string(name) + ".br")) << "brotli";
+    }
+
+    {
+        ContentConfig   config;
+        config.maxOpenFiles = 4;
+        config.watchContent = false;
+        ContentStore    store(contentDir, config);
+
+        std::size_t const   before = openDescriptors();
+        FileInfoPtr         one    = store.find("one.html");
+        FileInfoPtr         two    = store.find("two.html");
+        FileInfoPtr         three  = store.find("three.html");
+        CHECK(one && two && three);
+        CHECK(one->gzip && one->brotli && two->gzip && two->brotli && three->gzip && three->brotli);
+
+        CHECK(descriptors(*one) == 3);
+        CHECK(two->fd != -1);
+        CHECK(descriptors(*two) == 1);
+        CHECK(descriptors(*three) == 0);
+        CHECK(openDescriptors() - before == 4);
+    }
+
+    fs::remove_all(contentDir);
+    std::cout << "ContentStoreTest: OK\n";
+}
@@ -0,0 +1,81 @@
+#include "../ContentWatcher.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+
+/*
+ * A watched directory tree is renamed then recreated under the same names.
+ * The watch on the old subdirectory must not be reused: A file created in the new
+ * subdirectory has to be reported.
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+class Changes
+{
+    std::mutex                  mutex;
+    std::condition_variable     cond;
+    std::vector<fs::path>       changed;
+    public:
+        void add(fs::path const& path)
+        {
+            std::unique_lock    lock(mutex);
+            changed.push_back(path);
+            cond.notify_all();
+        }
+        // Wait for "path" to be reported.
+        bool waitFor(fs::path const& path)
+        {
+            std::unique_lock    lock(mutex);
+            return cond.wait_for(lock, 2s, [&](){return std::find(std::begin(changed), std::end(changed), path) != std::end(changed);});
+        }
+};
+
+int main()
+{
+#ifdef __linux__
+    fs::path const  root    = fs::temp_directory_path() / ("ContentWatcherTest." + std::to_string(::getpid()));
+    fs::path const  top     = root / "top";
+    fs::path const  sub     = top / "sub";
+    fs::create_directories(sub);
+
+    Changes         changes;
+    {
+        ContentWatcher  watcher([&changes](fs::path const& changed){changes.add(changed);});
+        CHECK(watcher.watch(top));
+        CHECK(watcher.watch(sub));
+
+        // Move the tree away and wait for the watcher to see it.
+        fs::rename(top, root / "moved");
+        CHECK(changes.waitFor(top));
+
+        // The same names, new directories.
+        fs::create_directories(sub);
+        CHECK(watcher.watch(sub));
+        std::ofstream(sub / "file") << "data";
+        CHECK(changes.waitFor(sub / "file"));
+    }
+    fs::remove_all(root);
+    std::cout << "ContentWatcherTest: OK\n";
+#else
+    std::cout << "ContentWatcherTest: Skipped (no inotify)\n";
+#endif
+}
@@ -0,0 +1,120 @@
+#include "../Socket.h"
+#include "../HTTPStuff.h"
+#include "../ContentStore.h"
+#include "../Logger.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Range requests (RFC 7233):
+ *      Ranges that overlap or touch are merged. So a byte is only sent once.
+ *      Out of order ranges are sent in file order.
+ *      Ranges that can not be merged are sent as multipart/byteranges.
+ *      Nothing satisfiable gets a 416.
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+namespace fs = std::filesystem;
+
+struct Response
+{
+    std::string headers;
+    std::string body;
+    bool has(std::string_view header) const {return headers.find(header) != std::string::npos;}
+    std::size_t count(std::string_view text) const
+    {
+        std::size_t result = 0;
+        for (std::size_t pos = body.find(text); pos != std::string::npos; pos = body.find(text, pos + 1)) {
+            ++result;
+        }
+        return result;
+    }
+};
+
+Response get(ContentStore& store, std::string_view range)
+{
+    int fds[2];
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+    Socket  socket(fds[0]);
+    int     client = fds[1];
+
+    std::string request = "GET /file.txt HTTP/1.1\r\nhost: localhost\r\nrange: " + std::string(range) + "\r\n\r\n";
+    CHECK(::write(client, std::data(request), std::size(request)) == static_cast<::ssize_t>(std::size(request)));
+    CHECK(handleRequest(socket, store));
+    socket.sync();
+
+    // The response is small enough to be waiting in the socket buffer.
+    std::string response;
+    char        buffer[4096];
+    ::ssize_t   size;
+    while ((size = ::read(client, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, size);
+    }
+    ::close(client);
+
+    std::size_t headerEnd = response.find("\r\n\r\n");
+    CHECK(headerEnd != std::string::npos);
+    return {response.substr(0, headerEnd + 2), response.substr(headerEnd + 4)};
+}
+
+int main()
+{
+    Logger::instance().setOutput("/dev/null");
+
+    fs::path const      contentDir = fs::temp_directory_path() / ("RangeTest." + std::to_string(::getpid()));
+    fs::create_directories(contentDir);
+    std::string         file;
+    for (std::size_t loop = 0; loop < 100; ++loop) {
+        file += static_cast<char>('a' + loop % 26);
+    }
+    std::ofstream(contentDir / "file.txt") << file;
+
+    {
+        ContentStore    store(contentDir);
+
+        Response        overlap = get(store, "bytes=0-49,10-19,40-79");
+        CHECK(overlap.has("HTTP/1.1 206 Partial Content\r\n"));
+        CHECK(overlap.has("content-range: bytes 0-79/100\r\n"));
+        CHECK(overlap.body == file.substr(0, 80));
+
+        Response        adjacent = get(store, "bytes=20-29,10-19,-70");
+        CHECK(adjacent.has("content-range: bytes 10-99/100\r\n"));
+        CHECK(adjacent.body == file.substr(10));
+
+        // The same bytes asked for many times are only sent once.
+        Response        repeated = get(store, "bytes=0-99,0-99,0-99,0-99,0-99,0-99,0-99,0-99");
+        CHECK(repeated.has("content-range: bytes 0-99/100\r\n"));
+        CHECK(repeated.body == file);
+
+        Response        disjoint = get(store, "bytes=60-69,0-9,5-14");
+        CHECK(disjoint.has("content-type: multipart/byteranges;"));
+        CHECK(disjoint.count("content-range: ") == 2);
+        std::size_t     first  = disjoint.body.find("content-range: bytes 0-14/100\r\n\r\n" + file.substr(0, 15) + "\r\n");
+        std::size_t     second = disjoint.body.find("content-range: bytes 60-69/100\r\n\r\n" + file.substr(60, 10) + "\r\n");
+        CHECK(first != std::string::npos);
+        CHECK(second != std::string::npos);
+        CHECK(first < second);
+
+        Response        unsatisfiable = get(store, "bytes=100-200,150-");
+        CHECK(unsatisfiable.has("HTTP/1.1 416 Range Not Satisfiable\r\n"));
+        CHECK(unsatisfiable.has("content-range: bytes */100\r\n"));
+    }
+
+    fs::remove_all(contentDir);
+    std::cout << "RangeTest: OK\n";
+}
@@ -0,0 +1,138 @@
+#include "../Socket.h"
+#include "../Uring.h"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/*
+ * A Socket that reads and writes through a Uring (NisseV1 -u):
+ *      Lines and messages through recv() and send().
+ *      Buffered headers then a large file range through sendFile() (linked send and splices).
+ *      Several connections from one multishot accept.
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+void send(int fd, std::string_view data)
+{
+    CHECK(::write(fd, std::data(data), std::size(data)) == static_cast<::ssize_t>(std::size(data)));
+}
+
+std::string receive(int fd, std::size_t size)
+{
+    std::string result(size, '\0');
+    std::size_t done = 0;
+    while (done != size)
+    {
+        ::ssize_t amount = ::read(fd, std::data(result) + done, size - done);
+        CHECK(amount > 0);
+        done += amount;
+    }
+    return result;
+}
+
+void linesAndMessages(Uring& ring)
+{
+    int fds[2];
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    Socket  socket(fds[0], &ring);
+    int     client = fds[1];
+
+    send(client, "GET /one HTTP/1.1\r\nhost: here\r\n\r\n");
+    CHECK(socket.getNextLine() == "GET /one HTTP/1.1\r\n");
+    CHECK(socket.getNextLine() == "host: here\r\n");
+    CHECK(socket.getNextLine() == "\r\n");
+
+    socket.sendMessage("HTTP/1.1 200 OK\r\n");
+    socket.sendReference("\r\n");
+    socket.sync();
+    CHECK(receive(client, 19) == "HTTP/1.1 200 OK\r\n\r\n");
+
+    ::close(client);
+    char    buffer[16];
+    CHECK(socket.readBody(buffer, sizeof(buffer)) == 0);
+    CHECK(!socket.hasData());
+}
+
+void largeFile(Uring& ring)
+{
+    // Larger than the pipe (and the socket buffer) so it takes several splices.
+    std::size_t const   fileSize = 5 * 1024 * 1024 + 123;
+    std::string         content(fileSize, '\0');
+    for (std::size_t loop = 0; loop < fileSize; ++loop) {
+        content[loop] = static_cast<char>('a' + loop % 26);
+    }
+    char    fileName[] = "/tmp/UringTestXXXXXX";
+    int     fileFd = ::mkstemp(fileName);
+    CHECK(fileFd != -1);
+    ::unlink(fileName);
+    CHECK(::write(fileFd, std::data(content), fileSize) == static_cast<::ssize_t>(fileSize));
+
+    int fds[2];
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    int         client = fds[1];
+    std::string header = "HTTP/1.1 206 Partial Content\r\n\r\n";
+    std::size_t offset = 1000;
+    std::size_t size   = fileSize - 2000;
+    std::string received;
+    std::thread reader([&](){received = receive(client, std::size(header) + size);});
+    {
+        Socket  socket(fds[0], &ring);
+        socket.sendMessage(header);
+        socket.sendFileRange(fileFd, offset, size);
+        socket.sync();
+        reader.join();
+    }
+    CHECK(received == header + content.substr(offset, size));
+
+    ::close(client);
+    ::close(fileFd);
+}
+
+void multishotAccept(Uring& ring)
+{
+    int listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::sockaddr_in   address{};
+    ::socklen_t     size = sizeof(address);
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(::bind(listenFd, reinterpret_cast<::sockaddr*>(&address), sizeof(address)) == 0);
+    CHECK(::listen(listenFd, 8) == 0);
+    CHECK(::getsockname(listenFd, reinterpret_cast<::sockaddr*>(&address), &size) == 0);
+
+    for (int loop = 0; loop < 3; ++loop)
+    {
+        int client = ::socket(AF_INET, SOCK_STREAM, 0);
+        CHECK(::connect(client, reinterpret_cast<::sockaddr*>(&address), sizeof(address)) == 0);
+        send(client, "ping\r\n");
+        {
+            Socket  socket(ring.accept(listenFd), &ring);
+            CHECK(socket.getNextLine() == "ping\r\n");
+        }
+        ::close(client);
+    }
+    ::close(listenFd);
+}
+
+int main()
+{
+    Uring   ring;
+    linesAndMessages(ring);
+    largeFile(ring);
+    multishotAccept(ring);
+    std::cout << "UringTest: OK\n";
+}
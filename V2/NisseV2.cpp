@@ -1,4 +1,6 @@
 #include "../V1/Stream.h"
+#include "../V1/ContentStore.h"
+#include "../V1/HTTPStuff.h"
 #include "ServerInit.h"
 
 #include <ThorsSocket/Server.h>
@@ -20,7 +22,7 @@ namespace TASock    = ThorsAnvil::ThorsSocket;
  *
  */
 
-class Socket: public Stream
+class Socket final: public Stream
 {
     TASock::SocketStream    stream;
     public:
@@ -35,7 +37,8 @@ class Socket: public Stream
             return line;
         }
         virtual void ignore(std::size_t size)                   override {stream.ignore(size);}
-        virtual void sendMessage(std::string const& message)    override {stream << message;}
+        virtual std::size_t readBody(char* buffer, std::size_t size)    override {stream.read(buffer, size);return stream.gcount();}
+        virtual void sendMessage(std::string_view message)      override {stream << message;}
         virtual void sync()                                     override {stream.sync();}
         virtual bool hasData()  const                           override {return static_cast<bool>(stream);}
         virtual void close()                                    override {stream.close();}
@@ -45,7 +48,7 @@ class WebServer
 {
     TASock::Server                      connection;
     bool                                finished;
-    std::filesystem::path const&        contentDir;
+    ContentStore                        contentStore;
     public:
         WebServer(TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir);
 
@@ -90,7 +93,7 @@ int main(int argc, char* argv[])
 WebServer::WebServer(TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir)
     : connection{std::move(serverInit)}
     , finished{false}
-    , contentDir{contentDir}
+    , contentStore{contentDir}
 {}
 
 void WebServer::run()
@@ -100,7 +103,7 @@ void WebServer::run()
         TASock::SocketStream socketStream = connection.accept();
         Socket  socket(std::move(socketStream));
 
-        handleConnection(socket, contentDir);
+        handleConnection(socket, contentStore);
     }
 }
 
@@ -4,6 +4,16 @@
 #include <ThorsSocket/Server.h>
 #include <filesystem>
 #include <optional>
+#include <chrono>
+#include <cstddef>
+
+// Limits applied to client connections by the servers that track their open sockets (V4+).
+struct ConnectionLimits
+{
+    std::size_t                 maxConnections  = 10'000;   // Connections accepted past this are closed immediately.
+    std::chrono::milliseconds   headerTimeout   {10'000};   // Time allowed to send the headers of a request.
+    std::chrono::milliseconds   idleTimeout     {30'000};   // Time allowed between requests (keep-alive) or between reads of a body.
+};
 
 ThorsAnvil::ThorsSocket::ServerInit getServerInit(int port, std::optional<std::filesystem::path> certPath);
 
@@ -1,4 +1,6 @@
 #include "../V1/Stream.h"
+#include "../V1/ContentStore.h"
+#include "../V1/HTTPStuff.h"
 #include "../V2/ServerInit.h"
 
 #include <ThorsSocket/Server.h>
@@ -19,7 +21,7 @@ namespace TASock    = ThorsAnvil::ThorsSocket;
  *
  */
 
-class Socket: public Stream
+class Socket final: public Stream
 {
     TASock::SocketStream    stream;
     public:
@@ -34,7 +36,8 @@ class Socket: public Stream
             return line;
         }
         virtual void ignore(std::size_t size)                   override {stream.ignore(size);}
-        virtual void sendMessage(std::string const& message)    override {stream << message;}
+        virtual std::size_t readBody(char* buffer, std::size_t size)    override {stream.read(buffer, size);return stream.gcount();}
+        virtual void sendMessage(std::string_view message)      override {stream << message;}
         virtual void sync()                                     override {stream.sync();}
         virtual bool hasData()  const                           override {return static_cast<bool>(stream);}
         virtual void close()                                    override {stream.close();}
@@ -44,7 +47,7 @@ class WebServer
 {
     TASock::Server                      connection;
     bool                                finished;
-    std::filesystem::path const&        contentDir;
+    ContentStore                        contentStore;
     public:
         WebServer(TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir);
 
@@ -93,7 +96,7 @@ int main(int argc, char* argv[])
 WebServer::WebServer(TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir)
     : connection{std::move(serverInit)}
     , finished{false}
-    , contentDir{contentDir}
+    , contentStore{contentDir}
 {}
 
 void WebServer::run()
@@ -103,7 +106,7 @@ void WebServer::run()
         TASock::SocketStream socketStream = connection.accept();
         Socket  socket(std::move(socketStream));
 
-        handleConnection(socket, contentDir);
+        handleConnection(socket, contentStore);
     }
 }
 
@@ -1,13 +1,94 @@
 #include "JobQueue.h"
 #include <ThorsLogging/ThorsLogging.h>
+#include <algorithm>
+#include <utility>
 
-JobQueue::JobQueue(std::size_t workerCount)
-    : finished{false}
+// The WorkStealing queue (and deque) owned by the current thread (if it is a worker).
+static thread_local JobQueue*   currentQueue = nullptr;
+static thread_local std::size_t currentIndex = 0;
+
+// The Batch (if any) collecting the jobs added by the current thread.
+static thread_local JobQueue::Batch*    currentBatch = nullptr;
+
+// The smallest spin an adaptive thread shrinks to (so it can still find out spinning works).
+static constexpr std::size_t    minSpinBudget = 16;
+
+// Tell the CPU this is a spin loop (saves power and lets a hyper thread run).
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// JobQueue::LaneOrder
+// ===================
+JobQueue::LaneOrder::LaneOrder(std::size_t starvationLimit)
+    : starvationLimit{starvationLimit}
+    , taken{0}
+    , turn{0}
+{}
+
+std::size_t JobQueue::LaneOrder::first()
+{
+    if (starvationLimit == 0 || ++taken < starvationLimit) {
+        return 0;
+    }
+    // Give the lower lanes a turn (one at a time).
+    taken   = 0;
+    turn    = turn % (laneCount - 1) + 1;
+    return turn;
+}
+
+// JobQueue
+// ========
+JobQueue::JobQueue(std::size_t workerCount, Scheduler scheduler, SchedulePolicy policy)
+    : scheduler{scheduler}
+    , workerCount{workerCount}
+    , policy{std::move(policy)}
+    , spinLimit{std::thread::hardware_concurrency() > 1 ? this->policy.spinLimit : 0}
+    , finished{false}
+    , queued{0}
+    , queuedHint{0}
+    , spinning{0}
+    , laneOrder{this->policy.starvationLimit}
+    , injectSize{}
+    , sleepers{0}
 {
     try
     {
-        for (std::size_t loop = 0; loop < workerCount; ++loop) {
-            workers.emplace_back(&JobQueue::processWork, this);
+        for (std::size_t loop = 0; loop < workerCount; ++loop)
+        {
+            workerState.emplace_back(std::make_unique<Worker>());
+            workerState.back()->spinBudget = spinLimit;
+        }
+        if (scheduler == Scheduler::WorkStealing)
+        {
+            // All the deques must exist before any thread starts stealing.
+            for (std::size_t loop = 0; loop < workerCount * laneCount; ++loop) {
+                deques.emplace_back(std::make_unique<WorkDeque<Node>>());
+            }
+            for (auto& worker: workerState)
+            {
+                worker->nodes.reset(new Node[nodesPerWorker]);
+                worker->freeNodes.reserve(nodesPerWorker);
+                for (std::size_t loop = 0; loop < nodesPerWorker; ++loop)
+                {
+                    worker->nodes[loop].owner = worker.get();
+                    worker->freeNodes.push_back(&worker->nodes[loop]);
+                }
+            }
+            for (std::size_t loop = 0; loop < workerCount; ++loop) {
+                workers.emplace_back(&JobQueue::processStealingWork, this, loop);
+            }
+        }
+        else
+        {
+            for (std::size_t loop = 0; loop < workerCount; ++loop) {
+                workers.emplace_back(&JobQueue::processWork, this, loop);
+            }
         }
     }
     catch (...)
@@ -22,61 +103,471 @@ JobQueue::~JobQueue()
     stop();
 }
 
-void JobQueue::addJob(Work&& action)
+void JobQueue::addJob(Work&& action, Priority priority, Clock::time_point deadline)
+{
+    Job     job{std::move(action), deadline};
+    submit(std::span<Job>{&job, 1}, static_cast<std::size_t>(priority));
+}
+
+void JobQueue::addJobs(std::span<Work> actions, Priority priority, Clock::time_point deadline)
 {
+    // Reused so adding jobs does not allocate.
+    static thread_local std::vector<Job>    jobs;
+    for (auto& action: actions) {
+        jobs.emplace_back(Job{std::move(action), deadline});
+    }
+    submit(jobs, static_cast<std::size_t>(priority));
+    jobs.clear();
+}
+
+void JobQueue::submit(std::span<Job> jobs, std::size_t lane)
+{
+    if (policy.recordLatency)
+    {
+        Clock::time_point const now = Clock::now();
+        for (auto& job: jobs) {
+            job.added = now;
+        }
+    }
+    if (currentBatch != nullptr && &currentBatch->jobQueue == this)
+    {
+        for (auto& job: jobs) {
+            currentBatch->jobs[lane].emplace_back(std::move(job));
+        }
+        return;
+    }
+    enqueue(jobs, lane);
+}
+
+void JobQueue::enqueue(std::span<Job> jobs, std::size_t lane)
+{
+    if (jobs.empty()) {
+        return;
+    }
+    if (scheduler == Scheduler::WorkStealing) {
+        addStealingJobs(jobs, lane);
+        return;
+    }
     std::unique_lock    lock(workMutex);
-    workQueue.emplace(action);
-    workCV.notify_one();
+    for (auto& job: jobs) {
+        workQueue[lane].push(std::move(job));
+    }
+    queued += std::size(jobs);
+    queuedHint.store(queued, std::memory_order_relaxed);
+    // Only wake parked threads: A busy thread will find the work when it is done and each
+    // spinning thread will take at least one job (it checks the queue under the lock before parking).
+    // A spinning thread is only counted once: "queued" still holds the jobs it was already
+    // counted for (it stops spinning under the lock when it takes them).
+    std::size_t const   watching    = spinning.load(std::memory_order_relaxed);
+    std::size_t const   unclaimed   = queued > watching ? queued - watching : 0;
+    unpark(std::min(unclaimed, std::size(jobs)));
+}
+
+std::size_t JobQueue::fairShare(std::size_t waiting) const
+{
+    // Leave enough jobs for the other threads.
+    return std::clamp<std::size_t>((waiting + workerCount - 1) / workerCount, 1, drainSize);
 }
 
 void JobQueue::markFinished()
 {
+    // A thread checks "finished" under the lock before it parks.
+    // So after this every thread is either parked (and woken here) or will see it.
     std::unique_lock    lock(workMutex);
     finished = true;
+    unpark(std::size(parked));
 }
 
 void JobQueue::stop()
 {
     markFinished();
-    workCV.notify_all();
     for (auto& w: workers) {
         w.join();
     }
     workers.clear();
+
+    // Jobs that were never started are dropped (the same as the Shared queue).
+    for (auto& deque: deques)
+    {
+        while (Node* node = deque->take()) {
+            node->job = Job{};
+        }
+    }
+    for (auto& lane: injectQueue)
+    {
+        while (!lane.empty()) {
+            lane.pop();
+        }
+    }
 }
 
-std::optional<Work> JobQueue::getNextJob()
+LatencyHistogram JobQueue::latency() const
 {
-    std::unique_lock    lock(workMutex);
-    workCV.wait(lock, [&](){return !workQueue.empty() || finished;});
+    LatencyHistogram    result;
+    for (auto const& worker: workerState) {
+        result.merge(worker->latency);
+    }
+    return result;
+}
+
+void JobQueue::getNextJobs(Worker& self, std::vector<Job>& jobs)
+{
+    // Look for work without the lock before parking.
+    spinning.fetch_add(1, std::memory_order_relaxed);
+    spin(self, [&](){return queuedHint.load(std::memory_order_relaxed) != 0 || finished;});
 
-    if (workQueue.empty() || finished) {
-        return {};
+    std::unique_lock    lock(workMutex);
+    spinning.fetch_sub(1, std::memory_order_relaxed);
+    while (queued == 0 && !finished) {
+        park(self, lock);
+    }
+    if (finished) {
+        return;
     }
 
-    Work work = std::move(workQueue.front());
-    workQueue.pop();
-    return work;
+    for (std::size_t count = fairShare(queued); count != 0; --count)
+    {
+        std::size_t const   first = laneOrder.first();
+        for (std::size_t loop = 0; loop < laneCount; ++loop)
+        {
+            auto& lane = workQueue[(first + loop) % laneCount];
+            if (!lane.empty())
+            {
+                jobs.emplace_back(lane.pop());
+                break;
+            }
+        }
+    }
+    queued -= std::size(jobs);
+    queuedHint.store(queued, std::memory_order_relaxed);
 }
 
-void JobQueue::processWork()
+void JobQueue::processWork(std::size_t index)
 {
+    Worker&             self = *workerState[index];
+    std::vector<Job>    jobs;
+    jobs.reserve(drainSize);
     while (!finished)
     {
-        std::optional<Work> work   = getNextJob();
-        try
+        getNextJobs(self, jobs);
+        for (auto& job: jobs) {
+            runJob(self, job);
+        }
+        jobs.clear();
+    }
+}
+
+void JobQueue::runJob(Worker& self, Job& job)
+{
+    try
+    {
+        // The clock is only read for jobs that have a deadline (or to record latency).
+        if (job.deadline != noDeadline || policy.recordLatency)
         {
-            if (work.has_value()) {
-                (*work)();
+            Clock::time_point const now = Clock::now();
+            if (now > job.deadline)
+            {
+                if (policy.shed) {
+                    policy.shed(job.work);
+                }
+                return;
+            }
+            if (policy.recordLatency) {
+                self.latency.record(now - job.added);
             }
         }
-        catch (std::exception const& e)
-        {
-            ThorsLogWarning("ThorsAnvil::Nissa::JobQueue", "processWork", "Work Exception: ",  e.what());
+        job.work();
+    }
+    catch (std::exception const& e)
+    {
+        ThorsLogWarning("ThorsAnvil::Nissa::JobQueue", "processWork", "Work Exception: ",  e.what());
+    }
+    catch (...)
+    {
+        ThorsLogWarning("ThorsAnvil::Nissa::JobQueue", "processWork", "Work Exception: Unknown");
+    }
+}
+
+// Idle Threads
+// ============
+template<typename Ready>
+bool JobQueue::spin(Worker& self, Ready&& ready)
+{
+    bool    found = false;
+    for (std::size_t loop = 0; loop < self.spinBudget && !found; ++loop)
+    {
+        found = ready();
+        if (!found) {
+            cpuRelax();
+        }
+    }
+    for (std::size_t loop = 0; loop < policy.yieldLimit && !found; ++loop)
+    {
+        found = ready();
+        if (!found) {
+            std::this_thread::yield();
         }
-        catch (...)
+    }
+    if (policy.adaptiveSpin)
+    {
+        self.spinBudget = found
+                        ? std::min(spinLimit, std::max(self.spinBudget * 2, minSpinBudget))
+                        : std::max(self.spinBudget / 2, std::min(minSpinBudget, spinLimit));
+    }
+    return found;
+}
+
+void JobQueue::park(Worker& self, std::unique_lock<std::mutex>& lock)
+{
+    // Called with "workMutex" held: Any thread that adds work after this will see us in "parked".
+    self.parked.store(1, std::memory_order_relaxed);
+    parked.push_back(&self);
+    lock.unlock();
+    self.parked.wait(1, std::memory_order_acquire);
+    lock.lock();
+}
+
+void JobQueue::unpark(std::size_t count)
+{
+    // Called with "workMutex" held.
+    // The most recently parked thread is woken first (its cache is the warmest).
+    for (count = std::min(count, std::size(parked)); count != 0; --count)
+    {
+        Worker* worker = parked.back();
+        parked.pop_back();
+        worker->parked.store(0, std::memory_order_release);
+        worker->parked.notify_one();
+    }
+}
+
+// WorkStealing
+// ============
+void JobQueue::addStealingJobs(std::span<Job> jobs, std::size_t lane)
+{
+    if (currentQueue == this)
+    {
+        // One of our threads: Its own deque (no lock).
+        Worker&         self    = *workerState[currentIndex];
+        std::size_t     pushed  = 0;
+        for (; pushed != std::size(jobs); ++pushed)
         {
-            ThorsLogWarning("ThorsAnvil::Nissa::JobQueue", "processWork", "Work Exception: Unknown");
+            Node*   node = acquireNode(self);
+            if (node == nullptr) {
+                break;
+            }
+            node->job = std::move(jobs[pushed]);
+            deque(currentIndex, lane).push(node);
+        }
+        wake(pushed);
+        // If the thread's nodes are all in use the rest go on the injection queue.
+        jobs = jobs.subspan(pushed);
+        if (jobs.empty()) {
+            return;
+        }
+    }
+    bool    sleeping;
+    {
+        std::unique_lock    lock(injectMutex);
+        for (auto& job: jobs) {
+            injectQueue[lane].push(std::move(job));
+        }
+        injectSize[lane].fetch_add(std::size(jobs), std::memory_order_relaxed);
+        // A thread registers as a sleeper under "injectMutex" (see sleep()).
+        // So the lock orders this check with it: No fence is needed.
+        sleeping = sleepers.load(std::memory_order_relaxed) != 0;
+    }
+    if (sleeping)
+    {
+        std::unique_lock    lock(workMutex);
+        unpark(std::size(jobs));
+    }
+}
+
+void JobQueue::processStealingWork(std::size_t index)
+{
+    currentQueue = this;
+    currentIndex = index;
+    // Each thread starts its victim search in a different place.
+    std::uint32_t       random = static_cast<std::uint32_t>(index) * 2654435761U + 1;
+    LaneOrder           order(policy.starvationLimit);
+    Worker&             self = *workerState[index];
+    std::vector<Job>    jobs;
+    jobs.reserve(drainSize);
+
+    while (!finished)
+    {
+        std::size_t const   first = order.first();
+        for (std::size_t loop = 0; loop < laneCount && jobs.empty(); ++loop) {
+            findStealingJobs(index, (first + loop) % laneCount, random, jobs);
+        }
+        if (jobs.empty()) {
+            sleep(self);
+            continue;
+        }
+        for (auto& job: jobs) {
+            runJob(self, job);
+        }
+        jobs.clear();
+    }
+    currentQueue = nullptr;
+}
+
+void JobQueue::findStealingJobs(std::size_t index, std::size_t lane, std::uint32_t& random, std::vector<Job>& jobs)
+{
+    auto moveOut = [&](Node* node)
+    {
+        jobs.emplace_back(std::move(node->job));
+        releaseNode(*workerState[index], node);
+    };
+
+    // The empty() hints avoid the fences in take() and steal() for the lanes that have no work.
+    WorkDeque<Node>&    own = deque(index, lane);
+    if (Node* node = own.empty() ? nullptr : own.take()) {
+        return moveOut(node);
+    }
+    if (takeInjectedJobs(lane, jobs)) {
+        return;
+    }
+
+    // Steal: Try every other thread once, starting at a random one.
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    std::size_t const   start = random % workerCount;
+    for (std::size_t loop = 0; loop < workerCount; ++loop)
+    {
+        std::size_t victim = (start + loop) % workerCount;
+        WorkDeque<Node>&    other = deque(victim, lane);
+        if (victim == index || other.empty()) {
+            continue;
+        }
+        if (Node* node = other.steal()) {
+            return moveOut(node);
+        }
+    }
+}
+
+JobQueue::Node* JobQueue::acquireNode(Worker& self)
+{
+    if (self.freeNodes.empty())
+    {
+        // Collect the nodes the other threads have given back (all of them at once).
+        for (Node* node = self.returnedNodes.exchange(nullptr, std::memory_order_acquire); node != nullptr; node = node->next) {
+            self.freeNodes.push_back(node);
         }
+        if (self.freeNodes.empty()) {
+            return nullptr;
+        }
+    }
+    Node*   node = self.freeNodes.back();
+    self.freeNodes.pop_back();
+    return node;
+}
+
+void JobQueue::releaseNode(Worker& self, Node* node)
+{
+    // The node's job has been moved out: It is empty.
+    Worker& owner = *node->owner;
+    if (&owner == &self)
+    {
+        owner.freeNodes.push_back(node);
+        return;
+    }
+    // Another thread's node (this thread stole the job): Push it on the owner's returned list.
+    // Only the owner takes from the list (all of it at once) so there is no ABA problem.
+    node->next = owner.returnedNodes.load(std::memory_order_relaxed);
+    while (!owner.returnedNodes.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+    {}
+}
+
+bool JobQueue::takeInjectedJobs(std::size_t lane, std::vector<Job>& jobs)
+{
+    // Checked without the lock so idle threads do not fight over an empty queue.
+    if (injectSize[lane].load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    std::unique_lock    lock(injectMutex);
+    auto&               queue = injectQueue[lane];
+    // This thread's share is run straight from "jobs" (the same as the Shared scheduler).
+    // Pushing them onto the deque would cost a node, a push and a take (with its fence) for each
+    // job only so another thread could steal them: The other threads take their own share instead.
+    for (std::size_t count = fairShare(std::size(queue)); count != 0 && !queue.empty(); --count) {
+        jobs.emplace_back(queue.pop());
+    }
+    injectSize[lane].fetch_sub(std::size(jobs), std::memory_order_relaxed);
+    return !jobs.empty();
+}
+
+bool JobQueue::hasStealingJob() const
+{
+    for (auto const& size: injectSize)
+    {
+        if (size.load(std::memory_order_relaxed) != 0) {
+            return true;
+        }
+    }
+    for (auto const& deque: deques)
+    {
+        if (!deque->empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobQueue::sleep(Worker& self)
+{
+    if (spin(self, [&](){return finished || hasStealingJob();})) {
+        return;
+    }
+    // A thread registers as a sleeper then checks for work (under "workMutex").
+    // A thread that adds work makes it visible then checks for sleepers (see wake()).
+    // The seq_cst operations on both sides mean at least one of them sees the other.
+    // Jobs from other threads are injected under "injectMutex": Registering under that lock
+    // too means those are seen (or see us) without the injecting thread needing a fence.
+    std::unique_lock    lock(workMutex);
+    {
+        std::unique_lock    injectLock(injectMutex);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!finished && !hasStealingJob()) {
+        park(self, lock);
+    }
+    sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void JobQueue::wake(std::size_t count)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+    std::unique_lock    lock(workMutex);
+    unpark(count);
+}
+
+// Batch
+// =====
+JobQueue::Batch::Batch(JobQueue& jobQueue)
+    : jobQueue{jobQueue}
+    , previous{currentBatch}
+{
+    currentBatch = this;
+}
+
+JobQueue::Batch::~Batch()
+{
+    currentBatch = previous;
+    flush();
+}
+
+void JobQueue::Batch::flush()
+{
+    for (std::size_t lane = 0; lane < laneCount; ++lane)
+    {
+        jobQueue.enqueue(jobs[lane], lane);
+        // The moved from jobs are empty: Clear keeps the capacity for the next batch.
+        jobs[lane].clear();
     }
 }
@@ -6,36 +6,234 @@
  *
  * Constructor creates all the child threads.
  * New jobs added via `addJob()` which will then be executed ASAP by one of the threads.
+ * A job is a Task (see Task.h): Queuing and running a job does not allocate.
+ *
+ * Priorities:
+ *      Each job is added to one of three lanes (Priority High, Normal or Low). A thread takes
+ *      the job from the highest priority lane that has one. So a burst of new work can not delay
+ *      work that is already in progress (e.g. V6 resumes a coroutine in the middle of a
+ *      request at High but starts a new request at Normal).
+ *      Starvation: Every `SchedulePolicy::starvationLimit` jobs a thread takes, it starts looking
+ *      at a lower lane instead (each lower lane in turn). So a lower lane always gets at least one
+ *      job in every "starvationLimit * 2" however busy the higher lanes are. A limit of 0 is strict
+ *      priority (a lower lane only runs when every higher lane is empty).
+ *
+ * Deadlines:
+ *      A job can be given a deadline. If it has not started by then it is not run: It is passed
+ *      to `SchedulePolicy::shed` instead (or simply destroyed if there is no shed handler).
+ *      The shed handler is called by a worker thread.
+ *
+ * Idle threads:
+ *      A thread with no work spins (checking for work between "pause" instructions), then yields,
+ *      then parks. So work added soon after the thread ran out is picked up without a wake up
+ *      (a futex call and a context switch). The limits are in SchedulePolicy.
+ *      With `adaptiveSpin` each thread doubles its spin when spinning found work and halves it
+ *      when it had to park (so a quiet server stops burning CPU).
+ *      Each thread parks on its own atomic (std::atomic::wait(): a futex on Linux). The threads
+ *      that add work wake exactly the parked threads they need (none if a spinning thread will
+ *      take the work).
+ *      Spinning only helps if another core can add the work: On a single core machine the
+ *      threads park immediately.
+ *
+ * Latency:
+ *      With `SchedulePolicy::recordLatency` the time from adding a job until it starts is recorded.
+ *      `latency()` returns the histogram (all threads).
+ *
+ * Batching:
+ *      `addJobs()` adds several jobs with one lock and wakes only as many sleeping threads as
+ *      there are jobs (a thread is only woken if it is sleeping).
+ *      While a `JobQueue::Batch` exists the jobs added by the thread that created it are held
+ *      and submitted together when the batch is flushed (or destroyed). The EventHandler uses
+ *      this to submit all the jobs from one pass of the event loop at once.
+ *      A thread takes up to `drainSize` jobs at a time (never more than its fair share of the
+ *      jobs waiting) so it does not need the lock for every job.
+ *
+ * There are two schedulers (chosen when the JobQueue is constructed):
+ *      Shared:         One queue guarded by a mutex shared by all the threads.
+ *      WorkStealing:   Each thread owns a lock free WorkDeque.
+ *                      A job added by one of the threads goes onto its own deque (no lock).
+ *                      The deques hold pointers to nodes from a fixed pool owned by each thread
+ *                      (`nodesPerWorker`). A node is given back to the pool that owns it by
+ *                      whichever thread ran its job. If a thread's nodes are all in use the jobs
+ *                      it adds go onto the injection queue instead. So it never allocates.
+ *                      A job added by any other thread (the event loop) goes onto the
+ *                      injection queue.
+ *                      A thread looks for work on its own deque, then the injection queue,
+ *                      then steals from the other threads. If there is no work anywhere the
+ *                      thread sleeps until a job is added.
+ *                      A thread takes its fair share of the injection queue (up to drainSize)
+ *                      with one lock and runs them from a local list (the same as Shared).
+ *                      They are not put on its deque: That costs a push and a take for every job
+ *                      and the other threads take their own share from the queue anyway.
  */
 
-#include <queue>
+#include "Task.h"
+#include "TaskRing.h"
+#include "WorkDeque.h"
+#include "LatencyHistogram.h"
+
 #include <vector>
-#include <functional>
-#include <optional>
+#include <memory>
+#include <span>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+using Work    = Task;
+
+struct SchedulePolicy
+{
+    std::size_t                 starvationLimit = 8;    // Jobs taken before a lower lane gets a turn (0: Never).
+    std::function<void(Work&)>  shed;                   // Given the jobs that missed their deadline (optional).
+    // An idle thread checks for work "spinLimit" times then yields "yieldLimit" times then parks.
+    // Both 0: Park immediately.
+    std::size_t                 spinLimit       = 4096;
+    std::size_t                 yieldLimit      = 4;
+    bool                        adaptiveSpin    = true; // Each thread adjusts its spin (up to "spinLimit").
+    bool                        recordLatency   = false;
+};
 
-using Work    = std::function<void()>;
 class JobQueue
 {
-    std::vector<std::thread>        workers;
-    std::mutex                      workMutex;
-    std::condition_variable         workCV;
-    std::queue<Work>                workQueue;
-    bool                            finished;
+    public:
+        using Clock     = std::chrono::steady_clock;
+        enum class Scheduler {Shared, WorkStealing};
+        enum class Priority  {High, Normal, Low};
+        static constexpr std::size_t        drainSize       = 16;
+        static constexpr std::size_t        laneCount       = 3;
+        static constexpr std::size_t        nodesPerWorker  = 1024;
+        static constexpr Clock::time_point  noDeadline  = Clock::time_point::max();
+
+        // What is held on the queues.
+        struct Job
+        {
+            Work                work;
+            Clock::time_point   deadline    = noDeadline;
+            Clock::time_point   added       = {};       // Only set if recording latency.
+        };
+        class Batch;
+
+    private:
+        // The order the lanes are searched (one per worker, or the shared queue).
+        class LaneOrder
+        {
+            std::size_t     starvationLimit;
+            std::size_t     taken;
+            std::size_t     turn;
+            public:
+                LaneOrder(std::size_t starvationLimit);
+                // The lane to look at first. Then the lanes after it (wrapping round).
+                std::size_t first();
+        };
+        struct Worker;
+        // WorkStealing: What the deques point at.
+        struct Node
+        {
+            Job                 job;
+            Worker*             owner   = nullptr;
+            Node*               next    = nullptr;      // On "returnedNodes".
+        };
+        // The state of one thread.
+        struct alignas(64) Worker
+        {
+            std::atomic<std::uint32_t>  parked{0};      // 1 while parked. Set to 0 (and notified) to wake.
+            std::size_t                 spinBudget;
+            LatencyHistogram            latency;
+            // WorkStealing: The node pool.
+            std::unique_ptr<Node[]>     nodes;
+            std::vector<Node*>          freeNodes;      // This thread only.
+            std::atomic<Node*>          returnedNodes{nullptr};     // Given back by other threads.
+        };
+
+    private:
+        Scheduler const                 scheduler;
+        std::size_t const               workerCount;
+        SchedulePolicy const            policy;
+        std::size_t const               spinLimit;      // policy.spinLimit (0 on a single core).
+        std::vector<std::unique_ptr<Worker>>    workerState;
+        std::vector<std::thread>        workers;
+        std::atomic<bool>               finished;
+
+        // Parking: Guarded by "workMutex".
+        std::mutex                      workMutex;
+        std::vector<Worker*>            parked;
+
+        // Shared
+        std::array<TaskRing<Job>, laneCount>    workQueue;
+        std::size_t                     queued;         // Guarded by "workMutex".
+        std::atomic<std::size_t>        queuedHint;     // A copy of "queued" for spinning threads to watch.
+        std::atomic<std::size_t>        spinning;       // Threads looking for work without the lock.
+        LaneOrder                       laneOrder;      // Guarded by "workMutex".
+
+        // WorkStealing
+        std::vector<std::unique_ptr<WorkDeque<Node>>>   deques;     // One per thread per lane (index: thread * laneCount + lane).
+        std::mutex                      injectMutex;
+        std::array<TaskRing<Job>, laneCount>    injectQueue;
+        std::array<std::atomic<std::size_t>, laneCount> injectSize;     // Per lane: Read without the lock.
+        std::atomic<int>                sleepers;
 
     public:
-        JobQueue(std::size_t workerCount);
+        JobQueue(std::size_t workerCount, Scheduler scheduler = Scheduler::Shared, SchedulePolicy policy = {});
         ~JobQueue();
 
-        void addJob(Work&& action);
+        void addJob(Work&& action, Priority priority = Priority::Normal, Clock::time_point deadline = noDeadline);
+        // The jobs are moved from (the span itself is left holding empty tasks).
+        void addJobs(std::span<Work> actions, Priority priority = Priority::Normal, Clock::time_point deadline = noDeadline);
         void stop();
 
+        // The time from adding a job to it starting (if SchedulePolicy::recordLatency is set).
+        LatencyHistogram    latency() const;
+
     private:
-        std::optional<Work> getNextJob();
-        void                processWork();
+        void                submit(std::span<Job> jobs, std::size_t lane);
+        void                enqueue(std::span<Job> jobs, std::size_t lane);
+        void                getNextJobs(Worker& self, std::vector<Job>& jobs);
+        void                processWork(std::size_t index);
         void                markFinished();
+        void                runJob(Worker& self, Job& job);
+        std::size_t         fairShare(std::size_t waiting) const;
+
+        template<typename Ready>
+        bool                spin(Worker& self, Ready&& ready);
+        void                park(Worker& self, std::unique_lock<std::mutex>& lock);
+        void                unpark(std::size_t count);
+
+        WorkDeque<Node>&    deque(std::size_t index, std::size_t lane)  {return *deques[index * laneCount + lane];}
+        Node*               acquireNode(Worker& self);
+        void                releaseNode(Worker& self, Node* node);
+        void                addStealingJobs(std::span<Job> jobs, std::size_t lane);
+        void                processStealingWork(std::size_t index);
+        void                findStealingJobs(std::size_t index, std::size_t lane, std::uint32_t& random, std::vector<Job>& jobs);
+        bool                takeInjectedJobs(std::size_t lane, std::vector<Job>& jobs);
+        bool                hasStealingJob() const;
+        void                sleep(Worker& self);
+        void                wake(std::size_t count);
+};
+
+/*
+ * While a Batch exists the jobs the current thread adds to its JobQueue are collected.
+ * They are submitted with one addJobs() by flush() (or when the Batch is destroyed).
+ * Only the thread that created the Batch is affected; it must also be the one to destroy it.
+ */
+class JobQueue::Batch
+{
+    friend class JobQueue;
+    JobQueue&                                   jobQueue;
+    Batch*                                      previous;
+    std::array<std::vector<Job>, laneCount>     jobs;
+
+    public:
+        Batch(JobQueue& jobQueue);
+        ~Batch();
+
+        Batch(Batch const&)                 = delete;
+        Batch& operator=(Batch const&)      = delete;
+
+        void flush();
 };
 
 #endif
@@ -0,0 +1,125 @@
+#ifndef THORSANVIL_NISSE_LATENCY_HISTOGRAM_H
+#define THORSANVIL_NISSE_LATENCY_HISTOGRAM_H
+
+/*
+ * A histogram of latencies with log-linear buckets.
+ *
+ * Each power of 2 range of nanoseconds [2^N, 2^(N+1)) is split into `subBucketCount` equal
+ * buckets (below `subBucketCount` nanoseconds each bucket is 1ns wide). So a bucket is never
+ * wider than 1/16 of the values it holds.
+ *
+ * record() can be called by one thread while others read (the counts are relaxed atomics).
+ * Copying takes a snapshot. merge() adds another histogram's counts into this one.
+ * percentile() finds the bucket the percentile falls in and interpolates inside it
+ * (assuming the values in a bucket are spread evenly).
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+class LatencyHistogram
+{
+    public:
+        static constexpr std::size_t    subBucketBits   = 4;
+        static constexpr std::size_t    subBucketCount  = std::size_t{1} << subBucketBits;
+        static constexpr std::size_t    maxBits         = 40;   // Up to ~18 minutes.
+        static constexpr std::size_t    bucketCount     = (maxBits - subBucketBits + 1) * subBucketCount;
+
+    private:
+        std::array<std::atomic<std::uint64_t>, bucketCount>     buckets{};
+
+    public:
+        LatencyHistogram() = default;
+        LatencyHistogram(LatencyHistogram const& copy)
+        {
+            merge(copy);
+        }
+        LatencyHistogram& operator=(LatencyHistogram const& copy)
+        {
+            for (std::size_t loop = 0; loop < bucketCount; ++loop) {
+                buckets[loop].store(copy.buckets[loop].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            return *this;
+        }
+
+        // The bucket that holds "nano" (the last bucket holds everything larger).
+        static constexpr std::size_t bucketIndex(std::uint64_t nano)
+        {
+            if (nano < subBucketCount) {
+                return static_cast<std::size_t>(nano);
+            }
+            std::size_t const   shift   = std::bit_width(nano) - 1 - subBucketBits;
+            std::size_t const   index   = (shift + 1) * subBucketCount + ((nano >> shift) & (subBucketCount - 1));
+            return index < bucketCount ? index : bucketCount - 1;
+        }
+        // The smallest value held by bucket "index" and the number of values it holds.
+        static constexpr std::uint64_t bucketStart(std::size_t index)
+        {
+            if (index < subBucketCount) {
+                return index;
+            }
+            std::size_t const   shift   = index / subBucketCount - 1;
+            return (subBucketCount + index % subBucketCount) << shift;
+        }
+        static constexpr std::uint64_t bucketWidth(std::size_t index)
+        {
+            return index < subBucketCount ? 1 : std::uint64_t{1} << (index / subBucketCount - 1);
+        }
+
+        void record(std::chrono::nanoseconds latency)
+        {
+            std::uint64_t   nano    = latency.count() > 0 ? static_cast<std::uint64_t>(latency.count()) : 0;
+            buckets[bucketIndex(nano)].fetch_add(1, std::memory_order_relaxed);
+        }
+        void merge(LatencyHistogram const& other)
+        {
+            for (std::size_t loop = 0; loop < bucketCount; ++loop) {
+                buckets[loop].fetch_add(other.buckets[loop].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
+
+        std::uint64_t count() const
+        {
+            std::uint64_t   result = 0;
+            for (auto const& bucket: buckets) {
+                result += bucket.load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+        // "fraction" is 0.0 -> 1.0 (e.g. 0.99 for p99).
+        std::chrono::nanoseconds percentile(double fraction) const
+        {
+            std::uint64_t const total   = count();
+            double const        rank    = fraction * total;
+            std::uint64_t       seen    = 0;
+            for (std::size_t loop = 0; loop < bucketCount; ++loop)
+            {
+                std::uint64_t const inBucket = buckets[loop].load(std::memory_order_relaxed);
+                if (inBucket != 0 && seen + inBucket >= rank)
+                {
+                    // How far through this bucket's values the rank is.
+                    double const    offset = (rank - seen) / inBucket * bucketWidth(loop);
+                    return std::chrono::nanoseconds{static_cast<std::int64_t>(bucketStart(loop) + offset)};
+                }
+                seen += inBucket;
+            }
+            return std::chrono::nanoseconds{0};
+        }
+
+        friend std::ostream& operator<<(std::ostream& stream, LatencyHistogram const& histogram)
+        {
+            stream << "count: " << histogram.count()
+                   << " p50: " << histogram.percentile(0.50).count() << "ns"
+                   << " p90: " << histogram.percentile(0.90).count() << "ns"
+                   << " p99: " << histogram.percentile(0.99).count() << "ns"
+                   << " p99.9: " << histogram.percentile(0.999).count() << "ns";
+            return stream;
+        }
+};
+
+#endif
@@ -1,4 +1,7 @@
 #include "../V1/Stream.h"
+#include "../V1/ContentStore.h"
+#include "../V1/HTTPStuff.h"
+#include "../V1/Logger.h"
 #include "../V2/ServerInit.h"
 #include "JobQueue.h"
 
@@ -9,8 +12,15 @@
 
 #include <iostream>
 #include <exception>
+#include <string>
+#include <string_view>
+#include <chrono>
 #include <mutex>
 #include <map>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/time.h>
 
 namespace TASock    = ThorsAnvil::ThorsSocket;
 
@@ -18,36 +28,82 @@ namespace TASock    = ThorsAnvil::ThorsSocket;
  * Class Declarations:
  *
  *      Socket:             An implementation of Stream Interface using TASock::SocketStream
+ *                          The timeouts are SO_RCVTIMEO/SO_SNDTIMEO on the socket (the worker blocks in
+ *                          the read). The first line of a request waits up to "idleTimeout". The rest of
+ *                          the headers use "headerTimeout". The body and writes use "idleTimeout".
+ *                          Note: These limit each read, not the whole header (V5/V6 use a deadline).
  *      WebServer:          A class to represent and manage incoming connections.
+ *                          Connections past "maxConnections" are closed as soon as they are accepted.
+ *                          Note: Each connection holds a worker until it closes (or times out).
  *
  */
 
-class Socket: public Stream
+class Socket final: public Stream
 {
-    TASock::SocketStream    stream;
+    TASock::SocketStream        stream;
+    ConnectionLimits const*     limits;
+    std::string                 line;
+    bool                        waiting;        // Between requests.
+    std::chrono::milliseconds   readTimeout;    // The current SO_RCVTIMEO.
     public:
-        Socket(TASock::SocketStream&& stream)
+        Socket(TASock::SocketStream&& stream, ConnectionLimits const& limits)
             : stream(std::move(stream))
-        {}
+            , limits(&limits)
+            , waiting(false)
+            , readTimeout(0)
+        {
+            // A new connection: The request is expected straight away.
+            setTimeout(SO_RCVTIMEO, limits.headerTimeout);
+            setTimeout(SO_SNDTIMEO, limits.idleTimeout);
+            readTimeout = limits.headerTimeout;
+        }
 
         virtual std::string_view    getNextLine()               override
         {
-            static std::string line;
             std::getline(stream, line);
+            if (waiting)
+            {
+                // The next request has started: The rest of its headers must arrive in time.
+                waiting = false;
+                setReadTimeout(limits->headerTimeout);
+            }
             return line;
         }
         virtual void ignore(std::size_t size)                   override {stream.ignore(size);}
-        virtual void sendMessage(std::string const& message)    override {stream << message;}
+        virtual std::size_t readBody(char* buffer, std::size_t size)    override {stream.read(buffer, size);return stream.gcount();}
+        virtual void sendMessage(std::string_view message)      override {stream << message;}
         virtual void sync()                                     override {stream.sync();}
         virtual bool hasData()  const                           override {return static_cast<bool>(stream);}
         virtual void close()                                    override {stream.close();}
+        virtual void headersComplete()                          override {setReadTimeout(limits->idleTimeout);}
+        virtual void requestComplete()                          override {waiting = true;setReadTimeout(limits->idleTimeout);}
+
+    private:
+        void setReadTimeout(std::chrono::milliseconds timeout)
+        {
+            if (timeout != readTimeout)
+            {
+                setTimeout(SO_RCVTIMEO, timeout);
+                readTimeout = timeout;
+            }
+        }
+        void setTimeout(int option, std::chrono::milliseconds timeout)
+        {
+            ::timeval   value{};
+            value.tv_sec    = timeout.count() / 1000;
+            value.tv_usec   = (timeout.count() % 1000) * 1000;
+            if (::setsockopt(stream.getSocket().socketId(), SOL_SOCKET, option, &value, sizeof(value)) == -1) {
+                NISSE_LOG(Warning, "Failed to set socket timeout: ", errno, " ", strerror(errno));
+            }
+        }
 };
 
 class WebServer
 {
     TASock::Server                      connection;
     bool                                finished;
-    std::filesystem::path const&        contentDir;
+    ConnectionLimits                    limits;
+    ContentStore                        contentStore;
     // State information that can be used by the threads.
     // Objects placed in a std::map are not moved once inserted so taking
     // a reference to them is safe and can be used by another thread.
@@ -56,7 +112,7 @@ class WebServer
     // A JobQueue that holds a pool of threads to execute inserted jobs asynchronously.
     JobQueue                            jobQueue;
     public:
-        WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir);
+        WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir, ConnectionLimits const& limits = ConnectionLimits{});
 
         void run();
 };
@@ -65,9 +121,17 @@ int main(int argc, char* argv[])
 {
     static constexpr std::size_t workerCount = 4;
 
+    // Optional: -l <logFile>   Append the log to <logFile> (rather than stderr).
+    if (argc >= 3 && argv[1] == std::string_view{"-l"})
+    {
+        Logger::instance().setOutput(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+
     if (argc != 4 && argc != 3)
     {
-        std::cerr << "Usage: NisseV1 <port> <documentPath> [<SSL Certificate Path>]" << "\n";
+        std::cerr << "Usage: NisseV1 [-l <logFile>] <port> <documentPath> [<SSL Certificate Path>]" << "\n";
         return 1;
     }
 
@@ -102,10 +166,11 @@ int main(int argc, char* argv[])
 
 // WebServer
 // =========
-WebServer::WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir)
+WebServer::WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir, ConnectionLimits const& limits)
     : connection{std::move(serverInit)}
     , finished{false}
-    , contentDir{contentDir}
+    , limits{limits}
+    , contentStore{contentDir}
     , jobQueue{workerCount}
 {}
 
@@ -116,10 +181,15 @@ void WebServer::run()
         // Main thread waits for a new connection.
         TASock::SocketStream socketStream = connection.accept();
         int fd = socketStream.getSocket().socketId();
-        Socket newSocket(std::move(socketStream));
 
         // Add the “newSocket” into the std::map object “openSockets”
         std::unique_lock<std::mutex>    lock(openSocketMutex);
+        if (std::size(openSockets) >= limits.maxConnections)
+        {
+            // Note: socketStream is closed when it goes out of scope.
+            continue;
+        }
+        Socket newSocket(std::move(socketStream), limits);
         auto [iter, ok] = openSockets.insert_or_assign(fd, std::move(newSocket));
 
         // Add a lambda to the JobQueue to handle the newly created socket.
@@ -131,7 +201,7 @@ void WebServer::run()
             // Get a reference to the socket.
             auto& socket = iterator->second;
             // Handle the reference as before.
-            handleConnection(socket, contentDir);
+            handleConnection(socket, contentStore);
             // Once processing is complete remove the storage for Socket
             // and cleanup any associated storage.
             std::unique_lock<std::mutex>    lock(openSocketMutex);
@@ -0,0 +1,133 @@
+#ifndef THORSANVIL_NISSE_TASK_H
+#define THORSANVIL_NISSE_TASK_H
+
+/*
+ * A move only replacement for std::function<void()> that never allocates.
+ *
+ * The callable is stored inline in a buffer of "InlineSize" bytes.
+ * A callable that does not fit is a compile time error (see the static_assert in the constructor).
+ * If a large capture really is wanted the allocation must be asked for explicitly:
+ *
+ *      Task    task(Task::allowHeap, [big = std::move(bigObject)](){...});
+ *
+ * The default size (64 bytes) holds a lambda with eight captured pointers (or references).
+ * It can be changed for the whole build with -DNISSE_TASK_INLINE_SIZE=<bytes>.
+ *
+ * Inline callables must be nothrow move constructible so a queue can move them around
+ * (e.g. when its ring grows) without worrying about exceptions.
+ */
+
+#include <new>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+#ifndef NISSE_TASK_INLINE_SIZE
+#define NISSE_TASK_INLINE_SIZE  64
+#endif
+
+template<std::size_t InlineSize>
+class BasicTask
+{
+    struct Operations
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);     // Move construct dst from src then destroy src.
+        void (*destroy)(void* storage);
+    };
+
+    template<typename F>
+    static constexpr bool fitsInline    = sizeof(F) <= InlineSize
+                                       && alignof(F) <= alignof(std::max_align_t)
+                                       && std::is_nothrow_move_constructible_v<F>;
+
+    template<typename F>
+    static constexpr Operations inlineOperations = {
+        [](void* storage)           {(*std::launder(static_cast<F*>(storage)))();},
+        [](void* dst, void* src)    {F* from = std::launder(static_cast<F*>(src)); ::new (dst) F(std::move(*from)); from->~F();},
+        [](void* storage)           {std::launder(static_cast<F*>(storage))->~F();}
+    };
+    template<typename F>
+    static constexpr Operations heapOperations = {
+        [](void* storage)           {(**static_cast<F**>(storage))();},
+        [](void* dst, void* src)    {*static_cast<F**>(dst) = *static_cast<F**>(src);},
+        [](void* storage)           {delete *static_cast<F**>(storage);}
+    };
+
+    alignas(std::max_align_t) unsigned char storage[InlineSize];
+    Operations const*                       operations;
+
+    public:
+        struct AllowHeap {};
+        static constexpr AllowHeap  allowHeap{};
+
+        BasicTask() noexcept
+            : operations{nullptr}
+        {}
+        template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, BasicTask>>>
+        BasicTask(F&& action)
+            : operations{&inlineOperations<std::decay_t<F>>}
+        {
+            using Action = std::decay_t<F>;
+            static_assert(fitsInline<Action>, "Task: The callable does not fit in the inline storage. Make the capture smaller or use Task(Task::allowHeap, action).");
+            ::new (static_cast<void*>(storage)) Action(std::forward<F>(action));
+        }
+        template<typename F>
+        BasicTask(AllowHeap, F&& action)
+        {
+            using Action = std::decay_t<F>;
+            if constexpr (fitsInline<Action>)
+            {
+                ::new (static_cast<void*>(storage)) Action(std::forward<F>(action));
+                operations = &inlineOperations<Action>;
+            }
+            else
+            {
+                static_assert(sizeof(Action*) <= InlineSize);
+                *reinterpret_cast<Action**>(storage) = new Action(std::forward<F>(action));
+                operations = &heapOperations<Action>;
+            }
+        }
+        ~BasicTask()
+        {
+            reset();
+        }
+
+        BasicTask(BasicTask const&)                 = delete;
+        BasicTask& operator=(BasicTask const&)      = delete;
+        BasicTask(BasicTask&& move) noexcept
+            : operations{std::exchange(move.operations, nullptr)}
+        {
+            if (operations) {
+                operations->move(storage, move.storage);
+            }
+        }
+        BasicTask& operator=(BasicTask&& move) noexcept
+        {
+            if (this != &move)
+            {
+                reset();
+                operations = std::exchange(move.operations, nullptr);
+                if (operations) {
+                    operations->move(storage, move.storage);
+                }
+            }
+            return *this;
+        }
+
+        explicit operator bool() const noexcept    {return operations != nullptr;}
+        void     operator()()                       {operations->invoke(storage);}
+
+    private:
+        void reset() noexcept
+        {
+            if (operations) {
+                std::exchange(operations, nullptr)->destroy(storage);
+            }
+        }
+};
+
+using Task = BasicTask<NISSE_TASK_INLINE_SIZE>;
+
+#endif
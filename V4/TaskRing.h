@@ -0,0 +1,66 @@
+#ifndef THORSANVIL_NISSE_TASK_RING_H
+#define THORSANVIL_NISSE_TASK_RING_H
+
+/*
+ * A FIFO queue that stores its items by value in one contiguous circular buffer.
+ *
+ * Pushing and popping only move an item in or out of the buffer (no allocation).
+ * The buffer doubles in size when it is full, so once a server reaches its working
+ * size the queue never allocates again.
+ *
+ * Not thread safe: The owner guards it with a mutex.
+ */
+
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+template<typename T>
+class TaskRing
+{
+    std::unique_ptr<T[]>    items;
+    std::size_t             mask;
+    std::size_t             head;
+    std::size_t             tail;
+
+    public:
+        TaskRing(std::size_t capacity = 1024)      // Must be a power of 2.
+            : items{new T[capacity]}
+            , mask{capacity - 1}
+            , head{0}
+            , tail{0}
+        {}
+
+        bool        empty() const   {return head == tail;}
+        std::size_t size()  const   {return tail - head;}
+
+        void push(T&& item)
+        {
+            if (size() == mask + 1) {
+                grow();
+            }
+            items[tail & mask] = std::move(item);
+            ++tail;
+        }
+        // Must not be empty.
+        T pop()
+        {
+            T   item = std::move(items[head & mask]);
+            ++head;
+            return item;
+        }
+
+    private:
+        void grow()
+        {
+            std::size_t const       capacity = (mask + 1) * 2;
+            std::unique_ptr<T[]>    larger{new T[capacity]};
+            for (std::size_t loop = head; loop != tail; ++loop) {
+                larger[loop & (capacity - 1)] = std::move(items[loop & mask]);
+            }
+            items   = std::move(larger);
+            mask    = capacity - 1;
+        }
+};
+
+#endif
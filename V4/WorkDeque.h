@@ -0,0 +1,134 @@
+#ifndef THORSANVIL_NISSE_WORK_DEQUE_H
+#define THORSANVIL_NISSE_WORK_DEQUE_H
+
+/*
+ * A lock free work stealing deque (Chase-Lev).
+ *
+ * The owner thread calls push() and take() at the bottom. Any other thread calls steal() at
+ * the top. The owner only needs an atomic compare and swap when it races a thief for the
+ * last item, so pushing and taking work is normally just a couple of plain loads and stores.
+ *
+ * The items are pointers (the deque does not own what they point at).
+ * The buffer grows when it is full. The old buffers are kept until the deque is destroyed
+ * because a thief may still be reading from one.
+ *
+ * Memory ordering follows: "Correct and Efficient Work-Stealing for Weak Memory Models"
+ *                          (Le, Pop, Cohen, Zappa Nardelli. PPoPP 2013).
+ */
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+template<typename T>
+class WorkDeque
+{
+    class Buffer
+    {
+        std::int64_t const                  mask;
+        std::unique_ptr<std::atomic<T*>[]>  items;
+        public:
+            Buffer(std::int64_t capacity)
+                : mask{capacity - 1}
+                , items{new std::atomic<T*>[capacity]}
+            {}
+            std::int64_t    capacity() const                    {return mask + 1;}
+            T*              get(std::int64_t index) const       {return items[index & mask].load(std::memory_order_relaxed);}
+            void            put(std::int64_t index, T* item)    {items[index & mask].store(item, std::memory_order_relaxed);}
+    };
+
+    alignas(64) std::atomic<std::int64_t>   top;
+    alignas(64) std::atomic<std::int64_t>   bottom;
+    std::atomic<Buffer*>                    buffer;
+    std::vector<std::unique_ptr<Buffer>>    buffers;        // Owner only: All buffers ever used.
+
+    public:
+        WorkDeque(std::int64_t capacity = 256)  // Must be a power of 2.
+            : top{0}
+            , bottom{0}
+        {
+            buffers.emplace_back(std::make_unique<Buffer>(capacity));
+            buffer.store(buffers.back().get(), std::memory_order_relaxed);
+        }
+        WorkDeque(WorkDeque const&)             = delete;
+        WorkDeque& operator=(WorkDeque const&)  = delete;
+
+        // Owner only.
+        void push(T* item)
+        {
+            std::int64_t    b = bottom.load(std::memory_order_relaxed);
+            std::int64_t    t = top.load(std::memory_order_acquire);
+            Buffer*         a = buffer.load(std::memory_order_relaxed);
+            if (b - t > a->capacity() - 1) {
+                a = grow(a, t, b);
+            }
+            a->put(b, item);
+            bottom.store(b + 1, std::memory_order_release);
+        }
+
+        // Owner only: Returns nullptr if the deque is empty.
+        T* take()
+        {
+            std::int64_t    b = bottom.load(std::memory_order_relaxed) - 1;
+            Buffer*         a = buffer.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t    t = top.load(std::memory_order_relaxed);
+
+            if (t > b)
+            {
+                // Empty.
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            T*  item = a->get(b);
+            if (t == b)
+            {
+                // The last item: Race any thief for it.
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        // Any thread: Returns nullptr if the deque is empty (or another thread won the race).
+        T* steal()
+        {
+            std::int64_t    t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t    b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+            Buffer*         a       = buffer.load(std::memory_order_acquire);
+            T*              item    = a->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return item;
+        }
+
+        // Any thread: A hint (the deque can change at any time).
+        bool empty() const
+        {
+            return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+        }
+
+    private:
+        Buffer* grow(Buffer* old, std::int64_t t, std::int64_t b)
+        {
+            buffers.emplace_back(std::make_unique<Buffer>(old->capacity() * 2));
+            Buffer* a = buffers.back().get();
+            for (std::int64_t loop = t; loop < b; ++loop) {
+                a->put(loop, old->get(loop));
+            }
+            buffer.store(a, std::memory_order_release);
+            return a;
+        }
+};
+
+#endif
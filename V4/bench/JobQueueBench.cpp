@@ -0,0 +1,85 @@
+#include "../JobQueue.h"
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+/*
+ * JobQueue scheduling: make bench (or bench/JobQueueBench [<jobs>]).
+ *
+ * Throughput (jobs per second) of the Shared and WorkStealing schedulers:
+ *      external:   One thread (like the event loop) adds every job. At most 256 are outstanding.
+ *      spawn:      Each job added by the benchmark adds 16 more from the worker that runs it.
+ * For 1, 2, 4, 8 and 16 workers.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr std::size_t    outstanding = 256;
+static constexpr std::size_t    spawnCount  = 16;
+
+char const* name(JobQueue::Scheduler scheduler)
+{
+    return scheduler == JobQueue::Scheduler::Shared ? "shared" : "stealing";
+}
+
+void waitFor(std::atomic<std::size_t>& done, std::size_t count)
+{
+    while (done.load(std::memory_order_relaxed) < count) {
+        std::this_thread::yield();
+    }
+}
+
+void throughput(JobQueue::Scheduler scheduler, std::size_t workers, std::size_t jobs)
+{
+    std::atomic<std::size_t>    done{0};
+    double                      external;
+    double                      spawn;
+    {
+        JobQueue            jobQueue(workers, scheduler);
+        Clock::time_point   start = Clock::now();
+        for (std::size_t loop = 0; loop < jobs; ++loop)
+        {
+            while (loop - done.load(std::memory_order_relaxed) > outstanding) {
+                std::this_thread::yield();
+            }
+            jobQueue.addJob([&done](){done.fetch_add(1, std::memory_order_relaxed);});
+        }
+        waitFor(done, jobs);
+        external = std::chrono::duration<double>(Clock::now() - start).count();
+
+        done = 0;
+        std::size_t const   parents = jobs / spawnCount;
+        start = Clock::now();
+        for (std::size_t loop = 0; loop < parents; ++loop)
+        {
+            jobQueue.addJob([&done, &jobQueue]()
+            {
+                for (std::size_t child = 0; child < spawnCount; ++child) {
+                    jobQueue.addJob([&done](){done.fetch_add(1, std::memory_order_relaxed);});
+                }
+            });
+        }
+        waitFor(done, parents * spawnCount);
+        spawn = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    std::cout << std::left << std::setw(10) << name(scheduler) << std::right << " workers " << std::setw(2) << workers
+              << std::fixed << std::setprecision(2)
+              << "  external " << std::setw(7) << jobs / external / 1'000'000 << " Mjobs/s"
+              << "  spawn " << std::setw(7) << (jobs / spawnCount * spawnCount) / spawn / 1'000'000 << " Mjobs/s\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   jobs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1'000'000;
+
+    for (auto scheduler: {JobQueue::Scheduler::Shared, JobQueue::Scheduler::WorkStealing})
+    {
+        for (std::size_t workers: {1, 2, 4, 8, 16}) {
+            throughput(scheduler, workers, jobs);
+        }
+    }
+}
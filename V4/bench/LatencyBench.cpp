@@ -0,0 +1,66 @@
+#include "../JobQueue.h"
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+/*
+ * Dispatch latency: make bench (or bench/LatencyBench [<jobs>]).
+ *
+ * The time from addJob() until the job starts (SchedulePolicy::recordLatency) with both schedulers:
+ *      park:   Idle workers park immediately (spinLimit and yieldLimit 0).
+ *      spin:   Idle workers spin then yield then park (the default policy).
+ * Bursts of 4 jobs with a 50us gap between them. So the workers run out of work between
+ * bursts and have to be found (spinning) or woken (parked) for each one.
+ *
+ * Note: On a single core the spin limit is ignored (only the yields are left).
+ */
+
+using namespace std::chrono_literals;
+
+static constexpr std::size_t    burstSize   = 4;
+
+char const* name(JobQueue::Scheduler scheduler)
+{
+    return scheduler == JobQueue::Scheduler::Shared ? "shared" : "stealing";
+}
+
+void latency(JobQueue::Scheduler scheduler, bool spin, std::size_t jobs)
+{
+    SchedulePolicy  policy;
+    policy.recordLatency    = true;
+    if (!spin)
+    {
+        policy.spinLimit    = 0;
+        policy.yieldLimit   = 0;
+    }
+    std::atomic<std::size_t>    done{0};
+    JobQueue                    jobQueue(burstSize, scheduler, policy);
+    std::size_t const           bursts = (jobs + burstSize - 1) / burstSize;
+    for (std::size_t loop = 0; loop < bursts; ++loop)
+    {
+        for (std::size_t burst = 0; burst < burstSize; ++burst) {
+            jobQueue.addJob([&done](){done.fetch_add(1, std::memory_order_relaxed);});
+        }
+        std::this_thread::sleep_for(50us);
+    }
+    while (done.load(std::memory_order_relaxed) < bursts * burstSize) {
+        std::this_thread::yield();
+    }
+    std::cout << std::left << std::setw(10) << name(scheduler) << (spin ? " spin " : " park ") << jobQueue.latency() << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   jobs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20'000;
+
+    for (auto scheduler: {JobQueue::Scheduler::Shared, JobQueue::Scheduler::WorkStealing})
+    {
+        for (bool spin: {false, true}) {
+            latency(scheduler, spin, jobs);
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#include "../JobQueue.h"
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+
+/*
+ * One worker is spinning and the other is parked.
+ * Two jobs are added back to back (two addJob() calls). Each job waits for the other to
+ * start, so they only finish if the second job wakes the parked worker (the spinning
+ * worker can only be counted on to take one of them).
+ * Run with both schedulers (WorkStealing: The jobs are injected from outside the workers).
+ *
+ * A job adds more jobs than a WorkStealing worker has nodes (JobQueue::nodesPerWorker):
+ * The rest go on the injection queue and every job still runs.
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+using namespace std::chrono_literals;
+
+// The workers spin by yielding (the spin limit is ignored on a single core).
+// Long enough for the test to add jobs while a worker spins. Short enough to park soon after.
+static constexpr std::size_t    yieldLimit  = 1 << 14;
+static constexpr auto           parkTime    = 500ms;    // Every idle worker has parked by then.
+
+bool waitFor(std::atomic<int>& value, int expected, std::chrono::milliseconds timeout)
+{
+    auto const  end = std::chrono::steady_clock::now() + timeout;
+    while (value.load() < expected)
+    {
+        if (std::chrono::steady_clock::now() > end) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void spinningAndParkedWorker(JobQueue& jobQueue)
+{
+    // Both workers park. Then one is woken to run a job: When the job is done it spins.
+    std::this_thread::sleep_for(parkTime);
+    std::atomic<int>    first{0};
+    jobQueue.addJob([&first](){first = 1;});
+    CHECK(waitFor(first, 1, 1000ms));
+    std::this_thread::sleep_for(100us);
+
+    std::atomic<int>    started{0};
+    std::atomic<int>    passed{0};
+    auto job = [&started, &passed]()
+    {
+        ++started;
+        if (waitFor(started, 2, 1000ms)) {
+            ++passed;
+        }
+    };
+    jobQueue.addJob(job);
+    jobQueue.addJob(job);
+    CHECK(waitFor(started, 2, 3000ms));
+    // Both jobs must finish before "started" and "passed" go out of scope.
+    CHECK(waitFor(passed, 2, 3000ms));
+}
+
+void moreJobsThanNodes(JobQueue& jobQueue)
+{
+    static constexpr int    count = JobQueue::nodesPerWorker * 3 + 1;
+    std::atomic<int>        done{0};
+    jobQueue.addJob([&jobQueue, &done]()
+    {
+        for (int loop = 0; loop < count; ++loop) {
+            jobQueue.addJob([&done](){++done;});
+        }
+    });
+    CHECK(waitFor(done, count, 5000ms));
+}
+
+int main()
+{
+    SchedulePolicy  policy;
+    policy.spinLimit    = 0;
+    policy.yieldLimit   = yieldLimit;
+    policy.adaptiveSpin = false;
+    for (auto scheduler: {JobQueue::Scheduler::Shared, JobQueue::Scheduler::WorkStealing})
+    {
+        JobQueue        jobQueue(2, scheduler, policy);
+        for (int loop = 0; loop < 10; ++loop) {
+            spinningAndParkedWorker(jobQueue);
+        }
+        moreJobsThanNodes(jobQueue);
+        moreJobsThanNodes(jobQueue);    // Again: With the nodes given back by the first run.
+    }
+    std::cout << "JobQueueTest: OK\n";
+}
@@ -0,0 +1,67 @@
+#include "../LatencyHistogram.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+/*
+ * The log-linear buckets hold the values they claim to and the percentiles are interpolated
+ * (not rounded up to the end of a power of 2 bucket).
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+using namespace std::chrono_literals;
+
+bool near(std::chrono::nanoseconds value, std::chrono::nanoseconds expected)
+{
+    // Within 1%.
+    return (value - expected) * 100 <= expected && (expected - value) * 100 <= expected;
+}
+
+int main()
+{
+    // Every value is in the bucket whose range holds it.
+    for (std::uint64_t value: {0ULL, 1ULL, 15ULL, 16ULL, 17ULL, 31ULL, 32ULL, 33ULL, 1000ULL, 8191ULL, 8192ULL, 123456789ULL})
+    {
+        std::size_t const   index = LatencyHistogram::bucketIndex(value);
+        CHECK(LatencyHistogram::bucketStart(index) <= value);
+        CHECK(value < LatencyHistogram::bucketStart(index) + LatencyHistogram::bucketWidth(index));
+        CHECK(LatencyHistogram::bucketWidth(index) * LatencyHistogram::subBucketCount <= std::max<std::uint64_t>(value, LatencyHistogram::subBucketCount));
+    }
+    // Larger than the last bucket.
+    CHECK(LatencyHistogram::bucketIndex(~0ULL) == LatencyHistogram::bucketCount - 1);
+
+    // 1us to 100us evenly spread.
+    LatencyHistogram    histogram;
+    for (int loop = 1; loop <= 100'000; ++loop) {
+        histogram.record(std::chrono::nanoseconds{loop});
+    }
+    CHECK(histogram.count() == 100'000);
+    CHECK(near(histogram.percentile(0.50), 50us));
+    CHECK(near(histogram.percentile(0.90), 90us));
+    CHECK(near(histogram.percentile(0.99), 99us));
+
+    // All the same value: Every percentile is inside its (narrow) bucket.
+    LatencyHistogram    single;
+    for (int loop = 0; loop < 1000; ++loop) {
+        single.record(5000ns);
+    }
+    std::size_t const   bucket  = LatencyHistogram::bucketIndex(5000);
+    for (double fraction: {0.5, 0.9, 0.999})
+    {
+        std::uint64_t const value = single.percentile(fraction).count();
+        CHECK(LatencyHistogram::bucketStart(bucket) <= value);
+        CHECK(value <= LatencyHistogram::bucketStart(bucket) + LatencyHistogram::bucketWidth(bucket));
+    }
+
+    std::cout << "LatencyHistogramTest: OK\n";
+}
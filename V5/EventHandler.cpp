@@ -1,32 +1,82 @@
 #include "EventHandler.h"
 #include "../V4/JobQueue.h"
+#include "../V1/Logger.h"
+
+#include <vector>
 
 /*
  * C Callback functions.
  * Simply decide the data into EventHandler and call the C++ functions.
  */
-void eventCallback(evutil_socket_t fd, short eventType, void* data)
+void eventCallback(NativeSocket, short eventType, void* data)
+{
+    EventHandler::EventInfo&    info = *reinterpret_cast<EventHandler::EventInfo*>(data);
+    info.owner.eventAction(info, static_cast<EventType>(eventType));
+}
+
+void timerCallback(NativeSocket, short, void* data)
 {
     EventHandler&    eventHandler = *reinterpret_cast<EventHandler*>(data);
-    eventHandler.eventAction(fd, static_cast<EventType>(eventType));
+    eventHandler.timerAction();
 }
 
+#if defined(NISSE_EVENT_URING)
+// The io_uring wrapper is defined in EventHandlerUring.cpp
+#elif defined(NISSE_EVENT_EPOLL)
+/*
+ * Epoll wrapper. Set up C-Function callbacks
+ */
+Event::Event(EventBase& eventBase, int fd, EventType type, void* data)
+    : eventBase{&eventBase}
+    , fd{fd}
+    , type{type}
+    , timer{false}
+    , callback{&eventCallback}
+    , data{data}
+{}
+
+// A timer that repeats (see Event::add(int microsecondsPause)).
+Event::Event(EventBase& eventBase, void* data)
+    : eventBase{&eventBase}
+    , fd{::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)}
+    , type{EventType::Read}
+    , timer{true}
+    , callback{&timerCallback}
+    , data{data}
+{
+    if (fd == -1) {
+        throw std::runtime_error(Message{} << "Event: timerfd_create failed: " << errno << " " << strerror(errno));
+    }
+}
+#else
 /*
  * EventLib wrapper. Set up C-Function callbacks
  */
-Event::Event(EventBase& eventBase, int fd, EventType type, EventHandler& eventHandler)
-    : event{event_new(eventBase.eventBase, fd, static_cast<short>(type), &eventCallback, &eventHandler)}
+Event::Event(EventBase& eventBase, int fd, EventType type, void* data)
+    : event{event_new(eventBase.eventBase, fd, static_cast<short>(type), &eventCallback, data)}
+{}
+
+// A timer that repeats (see Event::add(int microsecondsPause)).
+Event::Event(EventBase& eventBase, void* data)
+    : event{event_new(eventBase.eventBase, -1, EV_PERSIST, &timerCallback, data)}
 {}
+#endif
 
 EventHandler::EventHandler(JobQueue& jobQueue)
     : jobQueue{jobQueue}
     , finished{false}
-{}
+    , timingWheel{tickInterval}
+    , tickEvent{eventBase, this}
+{
+    tickEvent.add(std::chrono::duration_cast<std::chrono::microseconds>(tickInterval).count());
+}
 
 void EventHandler::run()
 {
     finished = false;
-    eventBase.run();
+    // The jobs added by the handlers during one pass of the loop are submitted together.
+    JobQueue::Batch     batch(jobQueue);
+    eventBase.run([&](){batch.flush();releaseRetired();});
 }
 
 void EventHandler::stop()
@@ -34,30 +84,107 @@ void EventHandler::stop()
     finished = true;
 }
 
-void EventHandler::add(int fd, Handler&& h)
+void EventHandler::add(int fd, Handler&& h, Handler&& timeoutHandler, Duration timeout)
 {
-    std::cerr << "Adding Handler For: " << fd << "\n";
-    handlerMap[fd] = {std::move(h),
-                      Event{eventBase, fd, EventType::Read , *this},
-                      Event{eventBase, fd, EventType::Write , *this}
-                     };
+    NISSE_LOG(Debug, "Adding Handler For: ", fd);
+    std::unique_lock    lock(handlerMutex);
+    // A new socket can reuse the number of one that was closed.
+    auto old = handlerMap.find(fd);
+    if (old != std::end(handlerMap)) {
+        retire(old);
+    }
+    auto [iter, ok] = handlerMap.try_emplace(fd, *this, fd, std::move(h), std::move(timeoutHandler));
 
-    handlerMap[fd].read.add();
+    iter->second.read.add();
+    armTimer(iter->second, timeout);
 }
 
-void EventHandler::restore(int fd, bool read)
+void EventHandler::restore(int fd, bool read, Duration timeout)
 {
+    std::unique_lock    lock(handlerMutex);
+    auto find = handlerMap.find(fd);
+    if (find == std::end(handlerMap)) {
+        return;
+    }
     if (read) {
-        handlerMap[fd].read.add();
+        find->second.read.add();
     }
     else {
-        handlerMap[fd].write.add();
+        find->second.write.add();
     }
+    armTimer(find->second, timeout);
 }
 
-void EventHandler::eventAction(int fd, EventType)
+void EventHandler::remove(int fd)
 {
-    std::cerr << "Handler Event For: " << fd << "\n";
-    Handler&   handler   = handlerMap[fd].handler;
-    handler(fd);
+    NISSE_LOG(Debug, "Removing Handler For: ", fd);
+    std::unique_lock    lock(handlerMutex);
+    auto find = handlerMap.find(fd);
+    if (find != std::end(handlerMap)) {
+        retire(find);
+    }
+}
+
+void EventHandler::retire(HandlerMap::iterator find)
+{
+    // Called with "handlerMutex" held.
+    // The events and the timer are stopped now (the socket is about to be closed).
+    // The EventInfo (and its handlers) is destroyed at the end of the pass of the event loop.
+    EventInfo&  info = find->second;
+    info.read.del();
+    info.write.del();
+    timingWheel.cancel(info);
+    retired.emplace_back(handlerMap.extract(find));
+}
+
+void EventHandler::releaseRetired()
+{
+    std::unique_lock    lock(handlerMutex);
+    retired.clear();
+}
+
+void EventHandler::armTimer(EventInfo& info, Duration timeout)
+{
+    if (timeout != noTimeout && info.timeoutHandler) {
+        timingWheel.arm(info, timeout);
+    }
+}
+
+void EventHandler::eventAction(EventInfo& info, EventType)
+{
+    NISSE_LOG(Debug, "Handler Event For: ", info.fd);
+    {
+        std::unique_lock    lock(handlerMutex);
+        timingWheel.cancel(info);
+    }
+    // Note: The handler may remove the socket ("info" is kept until the end of the pass).
+    info.handler(info.fd);
+}
+
+void EventHandler::timerAction()
+{
+    if (finished)
+    {
+        // stop() was called: run() returns at the next tick.
+        eventBase.loopBreak();
+        return;
+    }
+    expired.clear();
+    {
+        std::unique_lock    lock(handlerMutex);
+        timingWheel.advance(TimingWheel::Clock::now(), [&](TimingWheel::Timer& timer)
+        {
+            // Remove the events so the normal handler can not also be called.
+            EventInfo&  info = static_cast<EventInfo&>(timer);
+            info.read.del();
+            info.write.del();
+            expired.emplace_back(&info);
+        });
+    }
+    // The handlers are called without the lock held as they will usually remove the socket.
+    for (EventInfo* info: expired)
+    {
+        NISSE_LOG(Debug, "Timeout For: ", info->fd);
+        info->timeoutHandler(info->fd);
+    }
 }
@@ -3,6 +3,8 @@
 
 /*
  * A thin wrapper on libEvent to C++ it.
+ * Building with -DNISSE_EVENT_EPOLL uses epoll directly instead (see EventHandlerEpoll.h).
+ * Building with -DNISSE_EVENT_URING uses io_uring instead (see EventHandlerUring.h).
  *
  * When an socket listener is first created via add() we store all data in the Store object.
  * When this has been created it adds the `ReadEvent` to libEvent to listen for any data.
@@ -10,6 +12,8 @@
  * When (if) a socket event is triggered we save a lambda on the JobQueue addJob() that will be
  * executed by a thread. The lambda restarts the CoRoutine which will either yield one of
  * three values.
+ * The jobs added during one pass of the event loop are held in a JobQueue::Batch and
+ * submitted together at the end of the pass (one lock and only the wakes needed).
  *
  * When the code yields one of three situations happens:
  *      * TaskYieldState::RestoreRead    We restore the read listener waiting for more data.
@@ -19,19 +23,44 @@
  * Note: This data is never destroyed immediately because the code may be executing on any thread.
  *       Instead a request is queued on the `Store` object. The main thread will then be used
  *       to clean up data (See Store for details).
+ *
+ * Timeouts:
+ *      A socket can be given a timeout when it is added or restored. If the event has not
+ *      triggered when the timeout expires the event is removed and the timeout handler is
+ *      called instead of the normal handler.
+ *      The timers are kept in a TimingWheel that is moved forward by a libEvent timer that
+ *      fires every "tickInterval". So arming or resetting a timer is O(1) however many
+ *      sockets are open. A timeout never expires early but can be up to two "tickInterval" late.
+ *
+ * Removing:
+ *      remove() stops the events and the timer immediately but the EventInfo is kept until the
+ *      end of the pass of the event loop (the handler that is running may be the one removing it).
+ *      So the handlers are called where they are stored (never copied).
  */
 
+#if defined(NISSE_EVENT_EPOLL)
+#include "EventHandlerEpoll.h"
+#elif defined(NISSE_EVENT_URING)
+#include "EventHandlerUring.h"
+#else
 #include "EventHandlerLibEvent.h"
+#endif
+#include "TimingWheel.h"
 #include "ThorsSocket/Server.h"
 #include "ThorsSocket/Socket.h"
 #include "ThorsSocket/SocketStream.h"
 #include <map>
+#include <vector>
 #include <functional>
+#include <mutex>
+#include <chrono>
 
 /*
  * C-Callback registered with LibEvent
+ * The "data" for a socket is its EventInfo. The "data" for the timer is the EventHandler.
  */
-extern "C" void eventCallback(evutil_socket_t fd, short eventType, void* data);
+extern "C" void eventCallback(NativeSocket fd, short eventType, void* data);
+extern "C" void timerCallback(NativeSocket fd, short eventType, void* data);
 
 namespace TASock   = ThorsAnvil::ThorsSocket;
 
@@ -42,31 +71,69 @@ struct OwnedFD;
 
 class EventHandler
 {
-    using Handler   = std::function<void(int)>;
-    struct EventInfo
-    {
-        Handler     handler;
-        Event       read;
-        Event       write;
-    };
-    using HandlerMap= std::map<int, EventInfo>;
+    public:
+        using Handler   = std::function<void(int)>;
+        using Duration  = std::chrono::milliseconds;
+        static constexpr Duration   noTimeout       = Duration::max();
+        static constexpr Duration   tickInterval    = Duration{100};
+
+    private:
+        // The timer is the base class so an expired timer can be converted back to its EventInfo.
+        // The events are given the address of the EventInfo so a triggered event leads
+        // straight back to it (it is never moved once it is in the map).
+        struct EventInfo: public TimingWheel::Timer
+        {
+            EventHandler&   owner;
+            int             fd;
+            Handler         handler;
+            Handler         timeoutHandler;
+            Event           read;
+            Event           write;
+
+            EventInfo(EventHandler& owner, int fd, Handler&& handler, Handler&& timeoutHandler)
+                : owner{owner}
+                , fd{fd}
+                , handler{std::move(handler)}
+                , timeoutHandler{std::move(timeoutHandler)}
+                , read{owner.eventBase, fd, EventType::Read, this}
+                , write{owner.eventBase, fd, EventType::Write, this}
+            {}
+        };
+        using HandlerMap= std::map<int, EventInfo>;
 
-    JobQueue&       jobQueue;
-    EventBase       eventBase;
-    bool            finished;
-    HandlerMap      handlerMap;
+        JobQueue&       jobQueue;
+        EventBase       eventBase;
+        bool            finished;
+        // Worker threads restore and remove sockets while the main thread runs the event loop.
+        // So the map and the wheel are guarded by "handlerMutex".
+        std::mutex      handlerMutex;
+        TimingWheel     timingWheel;
+        HandlerMap      handlerMap;
+        std::vector<HandlerMap::node_type>  retired;    // Removed: Destroyed at the end of the pass.
+        std::vector<EventInfo*>             expired;    // Only used by timerAction().
+        Event           tickEvent;
 
     public:
         EventHandler(JobQueue& jobQueue);
 
         void run();
         void stop();
-        void add(int fd, Handler&& h);
-        void restore(int fd, bool read);
+        // Add a socket and wait for it to be readable.
+        // If "timeout" is given then "timeoutHandler" is called if the socket does not become readable in time.
+        void add(int fd, Handler&& h, Handler&& timeoutHandler = {}, Duration timeout = noTimeout);
+        // Wait for the socket to be readable (or writeable) again.
+        void restore(int fd, bool read, Duration timeout = noTimeout);
+        // Stop listening to the socket (call before the socket is closed).
+        void remove(int fd);
 
     private:
-        friend void ::eventCallback(evutil_socket_t fd, short eventType, void* data);
-        void eventAction(int fd, EventType type);
+        friend void ::eventCallback(NativeSocket fd, short eventType, void* data);
+        friend void ::timerCallback(NativeSocket fd, short eventType, void* data);
+        void eventAction(EventInfo& info, EventType type);
+        void timerAction();
+        void armTimer(EventInfo& info, Duration timeout);
+        void retire(HandlerMap::iterator find);
+        void releaseRetired();
 };
 
 #endif
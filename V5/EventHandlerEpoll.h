@@ -0,0 +1,242 @@
+#ifndef THORSANVIL_NISSE_EVENT_HANDLER_EPOLL_H
+#define THORSANVIL_NISSE_EVENT_HANDLER_EPOLL_H
+
+/*
+ * The same types as EventHandlerLibEvent.h implemented directly on epoll (Linux only).
+ * Selected by building with -DNISSE_EVENT_EPOLL (make EVENT_BACKEND=epoll).
+ *
+ * EventBase is not copyable or movable.    An epoll instance.
+ * Event     is not copyable or movable.    One direction (read or write) of a socket, or a timer.
+ *
+ * Sockets are registered with EPOLLET | EPOLLONESHOT: After an event triggers the socket is
+ * disabled until add() is called again. So restoring an event is a single epoll_ctl() and
+ * never allocates. The read and write Event of a socket share one registration: add() sets
+ * the direction being waited for (the code only ever waits for one at a time).
+ *
+ * The epoll user data is a slot (fd and direction) and a generation. The slot holds the Event
+ * that was added. Removing (or re-adding) an Event bumps the generation of its slot. The slot is
+ * checked just before each event is dispatched, so an Event that was removed (or destroyed) by an
+ * earlier callback in the same epoll_wait() batch is skipped rather than triggered.
+ *
+ * The timer is a timerfd registered (level triggered) with the same epoll instance.
+ */
+
+#include "../V1/Stream.h"
+
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using NativeSocket          = int;
+using EventCallback         = void(*)(NativeSocket fd, short eventType, void* data);
+using PassComplete          = std::function<void()>;
+
+class EventHandler;
+enum class EventType : short{Read = EPOLLIN, Write = EPOLLOUT};
+
+
+class Event;
+class EventBase
+{
+    friend class Event;
+    static constexpr int    batchSize = 256;
+
+    int                     epollFd;
+    bool                    finished;
+    // Guards the slots (Events are added and removed by other threads).
+    std::mutex              slotMutex;
+    std::vector<Event*>     slots;          // Index: fd * 2 + direction.
+    std::vector<std::uint32_t>  generations;
+    public:
+        EventBase()
+            : epollFd(::epoll_create1(EPOLL_CLOEXEC))
+            , finished(false)
+        {
+            if (epollFd == -1) {
+                throw std::runtime_error(Message{} << "EventBase: epoll_create1 failed: " << errno << " " << strerror(errno));
+            }
+        }
+        ~EventBase()
+        {
+            ::close(epollFd);
+        }
+
+        EventBase(EventBase const&)                 = delete;
+        EventBase(EventBase&&)                      = delete;
+        EventBase& operator=(EventBase const&)      = delete;
+        EventBase& operator=(EventBase&&)           = delete;
+
+        // "passComplete" is called after the callbacks for each epoll_wait() have run.
+        void run(PassComplete const& passComplete);
+        void loopBreak()
+        {
+            finished = true;
+        }
+
+    private:
+        // Called with "slotMutex" held.
+        std::uint64_t   attach(Event& event);
+        void            detach(Event& event);
+        Event*          find(std::uint64_t userData);
+        bool            registered(int fd) const;
+};
+
+class Event
+{
+    friend class EventBase;
+    EventBase*              eventBase;
+    int                     fd;
+    EventType               type;
+    bool                    timer;      // The fd is a timerfd owned by this object.
+    EventCallback           callback;
+    void*                   data;
+
+    public:
+        Event(EventBase& eventBase, void* data);
+        Event(EventBase& eventBase, int fd, EventType type, void* data);
+
+        ~Event()
+        {
+            std::unique_lock    lock(eventBase->slotMutex);
+            eventBase->detach(*this);
+            if (timer) {
+                ::close(fd);
+            }
+            else if (type == EventType::Read && !eventBase->registered(fd)) {
+                // The registration is shared with the write Event: Remove it once.
+                // Not if the number has been reused by a socket that is now registered.
+                ::epoll_ctl(eventBase->epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            }
+        }
+        Event(Event const&)                         = delete;
+        Event(Event&&)                              = delete;
+        Event& operator=(Event const&)              = delete;
+        Event& operator=(Event&&)                   = delete;
+
+        void add()
+        {
+            std::unique_lock    lock(eventBase->slotMutex);
+            ::epoll_event   event{};
+            event.events    = static_cast<std::uint32_t>(type) | EPOLLET | EPOLLONESHOT;
+            event.data.u64  = eventBase->attach(*this);
+            // Usually the socket is already registered (MOD). The first add() registers it (ADD).
+            if (::epoll_ctl(eventBase->epollFd, EPOLL_CTL_MOD, fd, &event) == -1 && errno == ENOENT) {
+                ::epoll_ctl(eventBase->epollFd, EPOLL_CTL_ADD, fd, &event);
+            }
+        }
+        void add(int microsecondsPause)
+        {
+            ::itimerspec    interval{};
+            interval.it_interval.tv_sec     = microsecondsPause / 1'000'000;
+            interval.it_interval.tv_nsec    = (microsecondsPause % 1'000'000) * 1000L;
+            interval.it_value               = interval.it_interval;
+            ::timerfd_settime(fd, 0, &interval, nullptr);
+
+            std::unique_lock    lock(eventBase->slotMutex);
+            ::epoll_event   event{};
+            event.events    = EPOLLIN;
+            event.data.u64  = eventBase->attach(*this);
+            ::epoll_ctl(eventBase->epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+        void del()
+        {
+            // Leave the socket registered but disabled (the same state as after ONESHOT triggers).
+            // Anything already reported for it (in the batch being dispatched) is ignored.
+            std::unique_lock    lock(eventBase->slotMutex);
+            eventBase->detach(*this);
+            ::epoll_event   event{};
+            ::epoll_ctl(eventBase->epollFd, EPOLL_CTL_MOD, fd, &event);
+        }
+
+    private:
+        std::size_t slot() const    {return static_cast<std::size_t>(fd) * 2 + (type == EventType::Read ? 0 : 1);}
+        void trigger()
+        {
+            if (timer)
+            {
+                std::uint64_t   expirations;
+                [[maybe_unused]] ::ssize_t readStatus = ::read(fd, &expirations, sizeof(expirations));
+            }
+            callback(fd, static_cast<short>(type), data);
+        }
+};
+
+inline void EventBase::run(PassComplete const& passComplete)
+{
+    finished = false;
+    ::epoll_event   events[batchSize];
+    while (!finished)
+    {
+        int count = ::epoll_wait(epollFd, events, batchSize, -1);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        if (count == -1) {
+            throw std::runtime_error(Message{} << "EventBase: epoll_wait failed: " << errno << " " << strerror(errno));
+        }
+        for (int loop = 0; loop < count; ++loop)
+        {
+            // Looked up one at a time: An earlier callback may have removed this Event.
+            Event*  event;
+            {
+                std::unique_lock    lock(slotMutex);
+                event = find(events[loop].data.u64);
+            }
+            if (event != nullptr) {
+                event->trigger();
+            }
+        }
+        passComplete();
+    }
+}
+
+inline std::uint64_t EventBase::attach(Event& event)
+{
+    std::size_t const   index = event.slot();
+    if (index >= std::size(slots))
+    {
+        slots.resize(index + 1, nullptr);
+        generations.resize(index + 1, 0);
+    }
+    slots[index] = &event;
+    // A new generation: Anything already reported for the slot is ignored.
+    return (std::uint64_t{++generations[index]} << 32) | index;
+}
+
+inline void EventBase::detach(Event& event)
+{
+    std::size_t const   index = event.slot();
+    if (index < std::size(slots) && slots[index] == &event)
+    {
+        slots[index] = nullptr;
+        ++generations[index];
+    }
+}
+
+inline Event* EventBase::find(std::uint64_t userData)
+{
+    std::size_t const   index       = userData & 0xFFFF'FFFF;
+    std::uint32_t const generation  = userData >> 32;
+    if (index >= std::size(slots) || generations[index] != generation) {
+        return nullptr;
+    }
+    return slots[index];
+}
+
+inline bool EventBase::registered(int fd) const
+{
+    std::size_t const   index = static_cast<std::size_t>(fd) * 2;
+    return index + 1 < std::size(slots) && (slots[index] != nullptr || slots[index + 1] != nullptr);
+}
+
+
+#endif
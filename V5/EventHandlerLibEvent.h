@@ -9,11 +9,15 @@
  */
 
 #include <event2/event.h>
+#include <event2/thread.h>
+#include <functional>
 #include <utility>
 
 using LibEventEventBase     = ::event_base;
 using LibEventEvent         = ::event;
 using LibEventTimeOut       = ::timeval;
+using NativeSocket          = evutil_socket_t;
+using PassComplete          = std::function<void()>;
 
 class EventHandler;
 enum class EventType : short{Read = EV_READ, Write = EV_WRITE};
@@ -24,9 +28,11 @@ class EventBase
 {
     friend class Event;
     LibEventEventBase*      eventBase;
+    bool                    finished;
     public:
         EventBase()
-            : eventBase(event_base_new())
+            : eventBase(newEventBase())
+            , finished(false)
         {}
         ~EventBase()
         {
@@ -38,14 +44,30 @@ class EventBase
         EventBase& operator=(EventBase const&)      = delete;
         EventBase& operator=(EventBase&&)           = delete;
 
-        void run()
+        // "passComplete" is called after the callbacks for each batch of active events have run.
+        void run(PassComplete const& passComplete)
         {
-            event_base_loop(eventBase, EVLOOP_NO_EXIT_ON_EMPTY);
+            finished = false;
+            while (!finished)
+            {
+                event_base_loop(eventBase, EVLOOP_ONCE | EVLOOP_NO_EXIT_ON_EMPTY);
+                passComplete();
+            }
         }
         void loopBreak()
         {
+            finished = true;
             event_base_loopbreak(eventBase);
         }
+    private:
+        static LibEventEventBase* newEventBase()
+        {
+            // Events are added by other threads (workers and other event loops).
+            // So libEvent must lock its structures and wake the loop when that happens.
+            static int const threadSupport = evthread_use_pthreads();
+            (void)threadSupport;
+            return event_base_new();
+        }
 };
 
 class Event
@@ -53,8 +75,9 @@ class Event
     LibEventEvent*          event;
 
     public:
-        Event(EventBase& eventBase, EventHandler& eventHandler);
-        Event(EventBase& eventBase, int fd, EventType type, EventHandler& eventHandler);
+        // "data" is passed to the callback when the event triggers.
+        Event(EventBase& eventBase, void* data);
+        Event(EventBase& eventBase, int fd, EventType type, void* data);
 
         Event()
             : event(nullptr)
@@ -85,6 +108,12 @@ class Event
             LibEventTimeOut timeout = {0, microsecondsPause};
             evtimer_add(event, &timeout);
         }
+        void del()
+        {
+            if (event) {
+                event_del(event);
+            }
+        }
 };
 
 
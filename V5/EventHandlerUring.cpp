@@ -0,0 +1,226 @@
+#ifdef NISSE_EVENT_URING
+
+#include "EventHandler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/*
+ * Io_uring wrapper. Set up C-Function callbacks
+ */
+
+// EventBase
+// =========
+EventBase::EventBase()
+    : ring{ringEntries}
+    , finished{false}
+{}
+
+void EventBase::run(PassComplete const& passComplete)
+{
+    {
+        std::unique_lock    lock(submitMutex);
+        loopThread  = std::this_thread::get_id();
+        finished    = false;
+    }
+    while (!finished)
+    {
+        // Submit everything queued by this thread and wait for at least one completion.
+        // Note: The kernel never submits more than is on the ring. So if another thread
+        //       submits some of these first nothing goes wrong.
+        unsigned    toSubmit;
+        {
+            std::unique_lock    lock(submitMutex);
+            toSubmit = ring.unsubmitted();
+        }
+        if (ring.enter(toSubmit, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            throw std::runtime_error(Message{} << "EventBase: io_uring_enter failed: " << errno << " " << strerror(errno));
+        }
+
+        std::uint64_t   ready[batchSize];
+        unsigned        count = 0;
+        {
+            std::unique_lock    lock(submitMutex);
+            ring.reap([&](::io_uring_cqe const& entry)
+            {
+                // Ignore the results of removes and of polls for events that have since been removed.
+                if (find(entry.user_data) != nullptr) {
+                    ready[count++] = entry.user_data;
+                }
+            }, batchSize);
+        }
+        // Called without the lock: The callbacks add events.
+        // Each completion is matched again just before it is triggered: An earlier callback may
+        // have removed (or destroyed) its Event. Until then the poll is still "inFlight" so
+        // removing the Event bumps the generation.
+        for (unsigned loop = 0; loop < count; ++loop)
+        {
+            Event*  event;
+            {
+                std::unique_lock    lock(submitMutex);
+                event = find(ready[loop]);
+                if (event != nullptr) {
+                    event->inFlight = 0;
+                }
+            }
+            if (event != nullptr) {
+                event->trigger();
+            }
+        }
+        passComplete();
+    }
+}
+
+void EventBase::push(::io_uring_sqe const& entry)
+{
+    ring.push(entry);
+
+    // The event loop submits its own entries the next time it waits.
+    // Any other thread must submit now as the loop may already be waiting.
+    if (std::this_thread::get_id() != loopThread) {
+        ring.enter(ring.unsubmitted(), 0, 0);
+    }
+}
+
+std::uint64_t EventBase::attach(Event& event)
+{
+    std::size_t const   index = event.slot();
+    if (index >= std::size(slots))
+    {
+        slots.resize(index + 1, nullptr);
+        generations.resize(index + 1, 0);
+    }
+    slots[index] = &event;
+    // A new generation: Anything still in flight for the slot is ignored.
+    return (std::uint64_t{++generations[index]} << 32) | index;
+}
+
+void EventBase::detach(Event& event)
+{
+    std::size_t const   index = event.slot();
+    if (index < std::size(slots) && slots[index] == &event)
+    {
+        slots[index] = nullptr;
+        ++generations[index];
+    }
+}
+
+Event* EventBase::find(std::uint64_t userData)
+{
+    std::size_t const   index       = userData & 0xFFFF'FFFF;
+    std::uint32_t const generation  = userData >> 32;
+    if (userData == ignoreResult || index >= std::size(slots) || generations[index] != generation) {
+        return nullptr;
+    }
+    return slots[index];
+}
+
+// Event
+// =====
+Event::Event(EventBase& eventBase, int fd, EventType type, void* data)
+    : eventBase{&eventBase}
+    , fd{fd}
+    , type{type}
+    , timer{false}
+    , callback{&eventCallback}
+    , data{data}
+    , inFlight{0}
+{}
+
+// A timer that repeats (see Event::add(int microsecondsPause)).
+Event::Event(EventBase& eventBase, void* data)
+    : eventBase{&eventBase}
+    , fd{::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)}
+    , type{EventType::Read}
+    , timer{true}
+    , callback{&timerCallback}
+    , data{data}
+    , inFlight{0}
+{
+    if (fd == -1) {
+        throw std::runtime_error(Message{} << "Event: timerfd_create failed: " << errno << " " << strerror(errno));
+    }
+}
+
+Event::~Event()
+{
+    {
+        std::unique_lock    lock(eventBase->submitMutex);
+        disarm();
+        eventBase->detach(*this);
+    }
+    if (timer) {
+        ::close(fd);
+    }
+}
+
+void Event::add()
+{
+    std::unique_lock    lock(eventBase->submitMutex);
+    arm();
+}
+
+void Event::add(int microsecondsPause)
+{
+    ::itimerspec    interval{};
+    interval.it_interval.tv_sec     = microsecondsPause / 1'000'000;
+    interval.it_interval.tv_nsec    = (microsecondsPause % 1'000'000) * 1000L;
+    interval.it_value               = interval.it_interval;
+    ::timerfd_settime(fd, 0, &interval, nullptr);
+    add();
+}
+
+void Event::del()
+{
+    std::unique_lock    lock(eventBase->submitMutex);
+    disarm();
+}
+
+void Event::arm()
+{
+    disarm();
+    inFlight = eventBase->attach(*this);
+
+    ::io_uring_sqe  entry{};
+    entry.opcode        = IORING_OP_POLL_ADD;
+    entry.fd            = fd;
+    entry.poll32_events = static_cast<std::uint32_t>(type);
+    entry.user_data     = inFlight;
+    eventBase->push(entry);
+}
+
+void Event::disarm()
+{
+    if (inFlight == 0) {
+        return;
+    }
+    // Ask the kernel to drop the poll. Its completion (and this one) are ignored.
+    ::io_uring_sqe  entry{};
+    entry.opcode        = IORING_OP_POLL_REMOVE;
+    entry.fd            = -1;
+    entry.addr          = inFlight;
+    entry.user_data     = EventBase::ignoreResult;
+    eventBase->push(entry);
+
+    eventBase->detach(*this);
+    inFlight = 0;
+}
+
+void Event::trigger()
+{
+    if (timer)
+    {
+        std::uint64_t   expirations;
+        [[maybe_unused]] ::ssize_t readStatus = ::read(fd, &expirations, sizeof(expirations));
+        // Polls are single shot: Wait for the next tick.
+        add();
+    }
+    callback(fd, static_cast<short>(type), data);
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef THORSANVIL_NISSE_EVENT_HANDLER_URING_H
+#define THORSANVIL_NISSE_EVENT_HANDLER_URING_H
+
+/*
+ * The same types as EventHandlerLibEvent.h implemented on io_uring (Linux 5.6+).
+ * Selected by building with -DNISSE_EVENT_URING (make EVENT_BACKEND=uring).
+ * The ring itself is a Uring (V1/Uring.h: The raw system calls, no liburing).
+ *
+ * EventBase is not copyable or movable.    An io_uring instance.
+ * Event     is not copyable or movable.    One direction (read or write) of a socket, or a timer.
+ *
+ * Adding an Event queues an IORING_OP_POLL_ADD (single shot) on the submission ring.
+ * The event loop submits everything queued and waits for completions in one io_uring_enter().
+ * So an Event restored by the event loop thread costs no system call at all. An Event restored
+ * by another thread (a worker) is submitted immediately with one io_uring_enter() (the loop
+ * may be waiting and would not see it otherwise). The same as the epoll_ctl() it replaces.
+ *
+ * Completions are matched to their Event by a slot (fd and direction) and a generation.
+ * Removing an Event bumps the generation of its slot so a completion that is still in flight
+ * for it is ignored. The match is repeated just before each completion is dispatched, so an Event
+ * removed by an earlier callback in the same batch is skipped rather than triggered.
+ *
+ * The timer is a timerfd polled by the same ring.
+ *
+ * Note: In V5/V6 the socket I/O itself is done by ThorsSocket inside handleConnection().
+ *       So the ring is used for readiness only; it does not perform the reads and writes.
+ *       NisseV1 -u is the version that reads, writes and accepts through a ring.
+ */
+
+#include "../V1/Stream.h"
+#include "../V1/Uring.h"
+
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+#include <poll.h>
+
+using NativeSocket          = int;
+using EventCallback         = void(*)(NativeSocket fd, short eventType, void* data);
+using PassComplete          = std::function<void()>;
+
+class EventHandler;
+enum class EventType : short{Read = POLLIN, Write = POLLOUT};
+
+
+class Event;
+class EventBase
+{
+    friend class Event;
+    static constexpr unsigned       ringEntries     = 4096;
+    static constexpr unsigned       batchSize       = 256;
+    static constexpr std::uint64_t  ignoreResult    = ~std::uint64_t{0};
+
+    Uring                           ring;
+    // Guards the ring and the slots.
+    std::mutex                      submitMutex;
+    std::thread::id                 loopThread;
+    std::vector<Event*>             slots;          // Index: fd * 2 + direction.
+    std::vector<std::uint32_t>      generations;
+    bool                            finished;
+
+    public:
+        EventBase();
+
+        EventBase(EventBase const&)                 = delete;
+        EventBase(EventBase&&)                      = delete;
+        EventBase& operator=(EventBase const&)      = delete;
+        EventBase& operator=(EventBase&&)           = delete;
+
+        // "passComplete" is called after the callbacks for each batch of completions have run.
+        void run(PassComplete const& passComplete);
+        void loopBreak()
+        {
+            finished = true;
+        }
+
+    private:
+        // Called with "submitMutex" held.
+        void            push(::io_uring_sqe const& entry);
+        std::uint64_t   attach(Event& event);
+        void            detach(Event& event);
+        Event*          find(std::uint64_t userData);
+};
+
+class Event
+{
+    friend class EventBase;
+    EventBase*              eventBase;
+    int                     fd;
+    EventType               type;
+    bool                    timer;      // The fd is a timerfd owned by this object.
+    EventCallback           callback;
+    void*                   data;
+    std::uint64_t           inFlight;   // The user data of the current poll (0 if there is none).
+
+    public:
+        Event(EventBase& eventBase, void* data);
+        Event(EventBase& eventBase, int fd, EventType type, void* data);
+        ~Event();
+
+        Event(Event const&)                         = delete;
+        Event(Event&&)                              = delete;
+        Event& operator=(Event const&)              = delete;
+        Event& operator=(Event&&)                   = delete;
+
+        void add();
+        void add(int microsecondsPause);
+        void del();
+
+    private:
+        std::size_t slot() const    {return static_cast<std::size_t>(fd) * 2 + (type == EventType::Read ? 0 : 1);}
+        void        arm();          // Called with "submitMutex" held.
+        void        disarm();       // Called with "submitMutex" held.
+        void        trigger();
+};
+
+
+#endif
@@ -1,4 +1,7 @@
 #include "../V1/Stream.h"
+#include "../V1/ContentStore.h"
+#include "../V1/HTTPStuff.h"
+#include "../V1/Logger.h"
 #include "../V2/ServerInit.h"
 #include "../V4/JobQueue.h"
 #include "EventHandler.h"
@@ -12,6 +15,15 @@
 #include <exception>
 #include <mutex>
 #include <map>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <string_view>
+
+#include <pthread.h>
+#include <sched.h>
 
 namespace TASock    = ThorsAnvil::ThorsSocket;
 
@@ -19,13 +31,30 @@ namespace TASock    = ThorsAnvil::ThorsSocket;
  * Class Declarations:
  *
  *      Socket:             An implementation of Stream Interface using TASock::SocketStream
+ *      Reactor:            An event loop with its own connection table and JobQueue.
+ *                          A connection is owned by one Reactor for its whole life.
+ *                          A connection that does not send a request within "headerTimeout" is closed.
+ *                          When a request arrives a worker handles it (and any others already sent)
+ *                          then the connection goes back to the event loop. So an idle keep-alive
+ *                          connection does not hold a worker and is closed after "idleTimeout".
+ *                          Note: Once a request has started the worker reads it to the end (see V6
+ *                          for timeouts within a request).
  *      WebServer:          A class to represent and manage incoming connections.
+ *                          The first Reactor listens for new connections and hands each one to a
+ *                          Reactor in turn (round robin).
+ *                          Connections past "maxConnections" are closed as soon as they are accepted.
+ *
+ *                          With one Reactor (the default) there is a single event loop and a shared
+ *                          pool of workers. With "-r <count>" there are <count> Reactors each with one
+ *                          worker, and each Reactor's threads are pinned to one core ("-r 0" uses
+ *                          one Reactor per core).
  *
  */
 
-class Socket: public Stream
+class Socket final: public Stream
 {
     TASock::SocketStream    stream;
+    std::string             line;
     public:
         Socket(TASock::SocketStream&& stream)
             : stream(std::move(stream))
@@ -33,23 +62,26 @@ class Socket: public Stream
 
         virtual std::string_view    getNextLine()               override
         {
-            static std::string line;
             std::getline(stream, line);
             return line;
         }
         virtual void ignore(std::size_t size)                   override {stream.ignore(size);}
-        virtual void sendMessage(std::string const& message)    override {stream << message;}
+        virtual std::size_t readBody(char* buffer, std::size_t size)    override {stream.read(buffer, size);return stream.gcount();}
+        virtual void sendMessage(std::string_view message)      override {stream << message;}
         virtual void sync()                                     override {stream.sync();}
         virtual bool hasData()  const                           override {return static_cast<bool>(stream);}
         virtual void close()                                    override {stream.close();}
+
+        // True if the next request has already been read into the stream's buffer.
+        bool hasBufferedData() const                            {return stream.rdbuf()->in_avail() > 0;}
 };
 
-class WebServer
+class Reactor
 {
-
-    TASock::Server                      connection;
-    bool                                finished;
-    std::filesystem::path const&        contentDir;
+    ContentStore&                       contentStore;
+    ConnectionLimits const&             limits;
+    std::atomic<std::size_t>&           openCount;      // Shared by all Reactors (for maxConnections).
+    int                                 core;           // -1: Not pinned.
     // State information that can be used by the threads.
     // Objects placed in a std::map are not moved once inserted so taking
     // a reference to them is safe and can be used by another thread.
@@ -59,12 +91,34 @@ class WebServer
     JobQueue                            jobQueue;
     EventHandler                        eventHandler;
     public:
-        WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir);
+        Reactor(std::size_t workerCount, int core, ContentStore& contentStore, ConnectionLimits const& limits, std::atomic<std::size_t>& openCount);
+
+        void            run();
+        // Take ownership of a newly accepted connection (called from the listening Reactor).
+        void            adopt(TASock::SocketStream&& socketStream);
+        EventHandler&   getEventHandler()   {return eventHandler;}
+    private:
+        void normalConnectionHandler(int fd);
+        void timeoutConnectionHandler(int fd);
+        void closeConnection(int fd);
+};
+
+class WebServer
+{
+
+    TASock::Server                      connection;
+    bool                                finished;
+    ConnectionLimits                    limits;
+    ContentStore                        contentStore;
+    std::atomic<std::size_t>            openCount;
+    std::deque<Reactor>                 reactors;
+    std::size_t                         nextReactor;
+    public:
+        WebServer(std::size_t reactorCount, std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir, ConnectionLimits const& limits = ConnectionLimits{});
 
         void run();
     private:
         void newConnectionHandler(int fd);
-        void normalConnectionHandler(int fd);
 };
 
 int main(int argc, char* argv[])
@@ -72,9 +126,28 @@ int main(int argc, char* argv[])
     loguru::g_stderr_verbosity = 9;
     static constexpr std::size_t workerCount = 4;
 
+    // Optional: -r <reactors>
+    //           -l <logFile>   Append the log to <logFile> (rather than stderr).
+    std::size_t reactorCount = 1;
+    while (argc >= 3 && (argv[1] == std::string_view{"-r"} || argv[1] == std::string_view{"-l"}))
+    {
+        if (argv[1] == std::string_view{"-l"}) {
+            Logger::instance().setOutput(argv[2]);
+        }
+        else
+        {
+            reactorCount = std::stoul(argv[2]);
+            if (reactorCount == 0) {
+                reactorCount = std::max(1U, std::thread::hardware_concurrency());
+            }
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
     if (argc != 4 && argc != 3)
     {
-        std::cerr << "Usage: NisseV1 <port> <documentPath> [<SSL Certificate Path>]" << "\n";
+        std::cerr << "Usage: NisseV1 [-r <reactors>] [-l <logFile>] <port> <documentPath> [<SSL Certificate Path>]" << "\n";
         return 1;
     }
 
@@ -88,7 +161,8 @@ int main(int argc, char* argv[])
         }
 
         std::cout << "Nisse Proto 5\n";
-        WebServer   server(workerCount, getServerInit(port, certDir), contentDir);
+        // One Reactor shares the pool of workers. Multiple Reactors get one worker each.
+        WebServer   server(reactorCount, reactorCount == 1 ? workerCount : 1, getServerInit(port, certDir), contentDir);
         server.run();
     }
     catch(std::exception const& e)
@@ -107,52 +181,161 @@ int main(int argc, char* argv[])
  * Class Implementation:
  */
 
-// WebServer
-// =========
-WebServer::WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir)
-    : connection{std::move(serverInit)}
-    , finished{false}
-    , contentDir{contentDir}
+// Pin the calling thread to "core" (no effect if "core" is -1).
+static void pinToCore(int core)
+{
+#ifdef __linux__
+    if (core == -1) {
+        return;
+    }
+    cpu_set_t   cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) {
+        NISSE_LOG(Warning, "Failed to pin thread to core: ", core);
+    }
+#else
+    (void)core;
+#endif
+}
+
+// Reactor
+// =======
+Reactor::Reactor(std::size_t workerCount, int core, ContentStore& contentStore, ConnectionLimits const& limits, std::atomic<std::size_t>& openCount)
+    : contentStore{contentStore}
+    , limits{limits}
+    , openCount{openCount}
+    , core{core}
     , jobQueue{workerCount}
     , eventHandler{jobQueue}
-{}
+{
+    // With a single worker this job runs on it: So the worker is pinned as well.
+    if (core != -1) {
+        jobQueue.addJob([core](){pinToCore(core);});
+    }
+}
 
-void WebServer::run()
+void Reactor::run()
 {
-    std::cerr << "Listen to: " << connection.socketId() << "\n";
-    eventHandler.add(connection.socketId(), [&](int fd){this->newConnectionHandler(fd);});
+    pinToCore(core);
     eventHandler.run();
 }
 
-void WebServer::newConnectionHandler(int)
+void Reactor::adopt(TASock::SocketStream&& socketStream)
 {
-    std::cerr << "newConnectionHandler\n";
-    // Main thread waits for a new connection.
-    TASock::SocketStream socketStream = connection.accept();
     int fd = socketStream.getSocket().socketId();
     Socket newSocket(std::move(socketStream));
 
     // Add the “newSocket” into the std::map object “openSockets”
     std::unique_lock<std::mutex>    lock(openSocketMutex);
-    auto [iter, ok] = openSockets.insert_or_assign(fd, std::move(newSocket));
+    openSockets.insert_or_assign(fd, std::move(newSocket));
 
-    eventHandler.add(fd, [&](int fd){this->normalConnectionHandler(fd);});
+    eventHandler.add(fd,
+                     [&](int fd){this->normalConnectionHandler(fd);},
+                     [&](int fd){this->timeoutConnectionHandler(fd);},
+                     limits.headerTimeout);
 }
 
-void WebServer::normalConnectionHandler(int fd)
+void Reactor::normalConnectionHandler(int fd)
 {
-    std::cerr << "normalConnectionHandler\n";
-    jobQueue.addJob([&](){
-        std::cerr << "Job Running\n";
+    NISSE_LOG(Debug, "normalConnectionHandler");
+    jobQueue.addJob([&, fd](){
+        NISSE_LOG(Debug, "Job Running");
         // Get a reference to the socket.
-        auto find = openSockets.find(fd);
-        auto& socket = find->second;
-        // Handle the reference as before.
-        handleConnection(socket, contentDir);
-        // Once processing is complete remove the storage for Socket
-        // and cleanup any associated storage.
-        std::unique_lock<std::mutex>    lock(openSocketMutex);
-        openSockets.erase(fd);
+        // Note: adopt() inserts into "openSockets" on another thread (the listening Reactor).
+        //       The reference stays valid after the lock is released (std::map does not move it).
+        Socket* found;
+        {
+            std::unique_lock<std::mutex>    lock(openSocketMutex);
+            found = &openSockets.find(fd)->second;
+        }
+        auto& socket = *found;
+        // Handle the requests that have arrived (a client can send several at once).
+        do
+        {
+            if (!socket.hasData() || !handleRequest(socket, contentStore))
+            {
+                // Once processing is complete remove the storage for Socket
+                // and cleanup any associated storage.
+                closeConnection(fd);
+                return;
+            }
+        }
+        while (socket.hasBufferedData());
+        // Give the connection back to the event loop to wait for the next request.
+        // Note: Nothing may use the socket after this (another worker may already have it).
+        eventHandler.restore(fd, true, limits.idleTimeout);
     });
 }
 
+void Reactor::timeoutConnectionHandler(int fd)
+{
+    // The timer only runs while the socket waits for a request.
+    // So no worker is using the socket and it can be closed here.
+    NISSE_LOG(Info, "Connection Timeout: ", fd);
+    closeConnection(fd);
+}
+
+void Reactor::closeConnection(int fd)
+{
+    // Stop listening before the socket is closed (the number can be reused).
+    eventHandler.remove(fd);
+    std::unique_lock<std::mutex>    lock(openSocketMutex);
+    openSockets.erase(fd);
+    --openCount;
+}
+
+// WebServer
+// =========
+WebServer::WebServer(std::size_t reactorCount, std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir, ConnectionLimits const& limits)
+    : connection{std::move(serverInit)}
+    , finished{false}
+    , limits{limits}
+    , contentStore{contentDir}
+    , openCount{0}
+    , nextReactor{0}
+{
+    unsigned const  cores = std::thread::hardware_concurrency();
+    for (std::size_t loop = 0; loop < reactorCount; ++loop)
+    {
+        int core = (reactorCount == 1 || cores == 0) ? -1 : static_cast<int>(loop % cores);
+        reactors.emplace_back(workerCount, core, contentStore, this->limits, openCount);
+    }
+}
+
+void WebServer::run()
+{
+    NISSE_LOG(Info, "Listen to: ", connection.socketId(), " Reactors: ", std::size(reactors));
+    reactors[0].getEventHandler().add(connection.socketId(), [&](int fd){this->newConnectionHandler(fd);});
+
+    // The first Reactor runs on this thread.
+    std::vector<std::thread>    threads;
+    for (std::size_t loop = 1; loop < std::size(reactors); ++loop) {
+        threads.emplace_back(&Reactor::run, &reactors[loop]);
+    }
+    reactors[0].run();
+    for (auto& thread: threads) {
+        thread.join();
+    }
+}
+
+void WebServer::newConnectionHandler(int listenFd)
+{
+    NISSE_LOG(Debug, "newConnectionHandler");
+    // Main thread waits for a new connection.
+    TASock::SocketStream socketStream = connection.accept();
+    int fd = socketStream.getSocket().socketId();
+    // The read event is not persistent: Listen for the next connection.
+    reactors[0].getEventHandler().restore(listenFd, true);
+
+    if (openCount >= limits.maxConnections)
+    {
+        NISSE_LOG(Warning, "Connection limit reached: Closing: ", fd);
+        // Note: socketStream is closed when it goes out of scope.
+        return;
+    }
+    ++openCount;
+    // Hand the connection to the next Reactor: It stays there until it is closed.
+    reactors[nextReactor].adopt(std::move(socketStream));
+    nextReactor = (nextReactor + 1) % std::size(reactors);
+}
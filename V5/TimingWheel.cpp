@@ -0,0 +1,74 @@
+#include "TimingWheel.h"
+
+#include <algorithm>
+
+// TimingWheel::Timer
+// ==================
+void TimingWheel::Timer::unlink()
+{
+    if (next != nullptr)
+    {
+        next->prev  = prev;
+        prev->next  = next;
+        next        = nullptr;
+        prev        = nullptr;
+    }
+}
+
+void TimingWheel::Timer::linkBefore(Timer& head)
+{
+    next        = &head;
+    prev        = head.prev;
+    prev->next  = this;
+    head.prev   = this;
+}
+
+// TimingWheel
+// ===========
+TimingWheel::TimingWheel(Clock::duration resolution)
+    : resolution{resolution}
+    , start{Clock::now()}
+    , currentTick{0}
+{
+    for (auto& level: levels)
+    {
+        for (auto& head: level)
+        {
+            head.next = &head;
+            head.prev = &head;
+        }
+    }
+}
+
+void TimingWheel::arm(Timer& timer, Clock::duration after)
+{
+    timer.unlink();
+
+    // Round up so a timer never expires early.
+    // Timers always expire in a future tick (the current tick has already been processed).
+    std::uint64_t when  = (Clock::now() + after - start + resolution - Clock::duration{1}) / resolution;
+    timer.expires       = std::clamp(when, currentTick + 1, currentTick + maxTicks);
+    insert(timer);
+}
+
+void TimingWheel::insert(Timer& timer)
+{
+    std::uint64_t   delta   = timer.expires - std::min(timer.expires, currentTick);
+    std::size_t     level   = 0;
+    while (level + 1 < levelCount && delta >= (std::uint64_t{1} << (levelBits * (level + 1)))) {
+        ++level;
+    }
+    std::size_t     slot    = (timer.expires >> (levelBits * level)) & (slotCount - 1);
+    timer.linkBefore(levels[level][slot]);
+}
+
+void TimingWheel::cascade(std::size_t level)
+{
+    Timer&  head = levels[level][(currentTick >> (levelBits * level)) & (slotCount - 1)];
+    while (head.next != &head)
+    {
+        Timer&  timer = *head.next;
+        timer.unlink();
+        insert(timer);
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef THORSANVIL_NISSE_TIMING_WHEEL_H
+#define THORSANVIL_NISSE_TIMING_WHEEL_H
+
+/*
+ * A hierarchical timing wheel.
+ *
+ * Time is counted in ticks of a fixed resolution. The wheel has "levelCount" levels of "slotCount"
+ * slots. Level 0 holds timers that expire within the next "slotCount" ticks (one slot per tick),
+ * level 1 holds timers that expire within the next "slotCount" squared ticks (one slot per
+ * "slotCount" ticks) and so on. Each slot is an intrusive doubly linked list of Timer objects.
+ *
+ * So arming, re-arming and cancelling a timer is O(1): it is linked into (or out of) one list.
+ * When the current tick reaches the start of a higher level slot the timers in it are moved
+ * down to the lower levels (this is the only time a timer is touched more than once).
+ *
+ * The Timer objects are owned by the caller (the wheel only links them together). A Timer
+ * removes itself from the wheel when it is destroyed.
+ *
+ * The wheel is not thread safe: The owner must serialize calls (see EventHandler).
+ */
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+class TimingWheel
+{
+    public:
+        using Clock     = std::chrono::steady_clock;
+
+        class Timer
+        {
+            friend class TimingWheel;
+            Timer*          next;
+            Timer*          prev;
+            std::uint64_t   expires;        // In ticks.
+
+            public:
+                Timer()
+                    : next{nullptr}
+                    , prev{nullptr}
+                    , expires{0}
+                {}
+                ~Timer()                            {unlink();}
+                Timer(Timer const&)                 = delete;
+                Timer& operator=(Timer const&)      = delete;
+
+                bool armed() const                  {return next != nullptr;}
+
+            private:
+                void unlink();
+                void linkBefore(Timer& head);
+        };
+
+        static constexpr std::size_t    levelBits   = 6;
+        static constexpr std::size_t    slotCount   = std::size_t{1} << levelBits;
+        static constexpr std::size_t    levelCount  = 4;
+        // Timers further away than this are clamped to it.
+        static constexpr std::uint64_t  maxTicks    = (std::uint64_t{1} << (levelBits * levelCount)) - 1;
+
+    private:
+        using Level     = std::array<Timer, slotCount>;     // Each slot is the head of a circular list.
+
+        Clock::duration const           resolution;
+        Clock::time_point const         start;
+        std::uint64_t                   currentTick;
+        std::array<Level, levelCount>   levels;
+
+    public:
+        TimingWheel(Clock::duration resolution);
+
+        TimingWheel(TimingWheel const&)             = delete;
+        TimingWheel& operator=(TimingWheel const&)  = delete;
+
+        Clock::duration tick() const                {return resolution;}
+
+        // Arm "timer" to expire "after" from now. If it is already armed it is moved.
+        void arm(Timer& timer, Clock::duration after);
+        void cancel(Timer& timer)                   {timer.unlink();}
+
+        // Move the wheel forward to "now".
+        // "expired" is called for each timer that expires. The timer has been removed from
+        // the wheel before the call, so the action may re-arm it.
+        template<typename Action>
+        void advance(Clock::time_point now, Action&& expired);
+
+    private:
+        void insert(Timer& timer);
+        void cascade(std::size_t level);
+};
+
+template<typename Action>
+void TimingWheel::advance(Clock::time_point now, Action&& expired)
+{
+    std::uint64_t const target = (now - start) / resolution;
+    while (currentTick < target)
+    {
+        ++currentTick;
+        // Move timers down from the higher levels whose slot starts at this tick.
+        for (std::size_t level = 1; level < levelCount && (currentTick & ((std::uint64_t{1} << (levelBits * level)) - 1)) == 0; ++level) {
+            cascade(level);
+        }
+
+        Timer&  head = levels[0][currentTick & (slotCount - 1)];
+        while (head.next != &head)
+        {
+            Timer&  timer = *head.next;
+            timer.unlink();
+            expired(timer);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include "../EventHandler.h"
+#include "../../V4/JobQueue.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Event dispatch through the EventHandler: make bench (or bench/EventBench [<hops>]).
+ *
+ * Tokens are passed round a ring of pipes. The handler for a pipe reads the tokens, writes
+ * them into the next pipe and restores its read event. So each hop is one readiness event
+ * through the EventHandler and the backend. Several tokens are in flight so each pass of the
+ * event loop dispatches a batch of events. Idle pipes (never written) are also registered.
+ *
+ * Compare the backends by building each one in turn (see the Makefile):
+ *      make bench EVENT_BACKEND=epoll
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr std::size_t    ringSize    = 256;
+static constexpr std::size_t    tokenCount  = 16;
+static constexpr std::size_t    idleCount   = 1024;
+
+#if defined(NISSE_EVENT_EPOLL)
+static char const* const        backend     = "epoll";
+#elif defined(NISSE_EVENT_URING)
+static char const* const        backend     = "uring";
+#else
+static char const* const        backend     = "libevent";
+#endif
+
+struct Pipe
+{
+    int     read;
+    int     write;
+    Pipe()
+    {
+        int fds[2];
+        if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+            std::cerr << "pipe2 failed\n";
+            std::exit(1);
+        }
+        read    = fds[0];
+        write   = fds[1];
+    }
+    ~Pipe()
+    {
+        ::close(read);
+        ::close(write);
+    }
+    Pipe(Pipe const&)               = delete;
+    Pipe& operator=(Pipe const&)    = delete;
+};
+
+int main(int argc, char* argv[])
+{
+    std::size_t const   hops = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2'000'000;
+
+    JobQueue            jobQueue(1);
+    EventHandler        eventHandler(jobQueue);
+    std::vector<Pipe>   ring(ringSize);
+    std::vector<Pipe>   idle(idleCount);
+    std::size_t         count   = 0;
+    Clock::time_point   end;
+
+    for (std::size_t loop = 0; loop < ringSize; ++loop)
+    {
+        int const   next = ring[(loop + 1) % ringSize].write;
+        eventHandler.add(ring[loop].read, [&, next](int fd)
+        {
+            char        tokens[tokenCount];
+            ::ssize_t   size = ::read(fd, tokens, sizeof(tokens));
+            if (size > 0)
+            {
+                [[maybe_unused]] ::ssize_t  written = ::write(next, tokens, size);
+                count += size;
+                if (count >= hops && end == Clock::time_point{})
+                {
+                    end = Clock::now();
+                    eventHandler.stop();
+                }
+            }
+            eventHandler.restore(fd, true);
+        });
+    }
+    for (auto& pipe: idle) {
+        eventHandler.add(pipe.read, [](int){});
+    }
+
+    // Spread the tokens round the ring.
+    for (std::size_t loop = 0; loop < tokenCount; ++loop) {
+        [[maybe_unused]] ::ssize_t  written = ::write(ring[loop * (ringSize / tokenCount)].write, "x", 1);
+    }
+    Clock::time_point   start = Clock::now();
+    eventHandler.run();
+
+    for (auto& pipe: ring) {
+        eventHandler.remove(pipe.read);
+    }
+    for (auto& pipe: idle) {
+        eventHandler.remove(pipe.read);
+    }
+    double const        time = std::chrono::duration<double>(end - start).count();
+    std::cout << std::left << std::setw(10) << backend << std::right << std::fixed << std::setprecision(2)
+              << std::setw(8) << count / time / 1'000'000 << " Mevents/s\n";
+}
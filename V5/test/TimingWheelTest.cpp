@@ -0,0 +1,145 @@
+#include "../TimingWheel.h"
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+/*
+ * Timers expire in the tick they were armed for: On level 0, after cascading down from each
+ * higher level and when clamped to "maxTicks". Re-arming moves a timer and cancelling (or
+ * destroying) it means it never fires.
+ *
+ * arm() rounds up from Clock::now(). So a timer armed for N ticks expires in tick N or N + 1
+ * (the wheel started a moment before it was armed). The tests advance the wheel to fixed
+ * ticks (the resolution is large so real time barely moves).
+ */
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition "\n";       \
+            std::exit(1);                                                                   \
+        }                                                                                   \
+    } while (false)
+
+using Clock     = TimingWheel::Clock;
+using Timer     = TimingWheel::Timer;
+
+constexpr Clock::duration   resolution = std::chrono::seconds(1);
+
+// Counts how many times each timer expired.
+struct Wheel
+{
+    TimingWheel             wheel{resolution};
+    Clock::time_point const start = Clock::now();       // Not before the wheel's own start.
+    std::vector<Timer*>     expired;
+
+    void arm(Timer& timer, std::uint64_t ticks)         {wheel.arm(timer, ticks * resolution);}
+    // Move the wheel to the start of tick "tick".
+    void advance(std::uint64_t tick)                    {wheel.advance(start + tick * resolution, [&](Timer& timer){expired.push_back(&timer);});}
+    std::size_t count(Timer const& timer) const
+    {
+        std::size_t result = 0;
+        for (Timer* item: expired) {
+            result += item == &timer;
+        }
+        return result;
+    }
+};
+
+void expiry()
+{
+    Wheel   wheel;
+    Timer   timer;
+    wheel.arm(timer, 5);
+    CHECK(timer.armed());
+    wheel.advance(4);
+    CHECK(wheel.count(timer) == 0);
+    wheel.advance(6);
+    CHECK(wheel.count(timer) == 1);
+    CHECK(!timer.armed());
+    wheel.advance(100);
+    CHECK(wheel.count(timer) == 1);
+}
+
+void cascade()
+{
+    // One timer on each level (64, 64^2 and 64^3 ticks per level).
+    Wheel   wheel;
+    Timer   timers[4];
+    std::uint64_t const ticks[4] = {50, 1'000, 100'000, 1'000'000};
+    for (std::size_t loop = 0; loop < 4; ++loop) {
+        wheel.arm(timers[loop], ticks[loop]);
+    }
+    for (std::size_t loop = 0; loop < 4; ++loop)
+    {
+        wheel.advance(ticks[loop] - 1);
+        CHECK(wheel.count(timers[loop]) == 0);
+        wheel.advance(ticks[loop] + 1);
+        CHECK(wheel.count(timers[loop]) == 1);
+    }
+    CHECK(std::size(wheel.expired) == 4);
+}
+
+void clamp()
+{
+    // Further away than the wheel can hold: Expires after "maxTicks".
+    Wheel   wheel;
+    Timer   timer;
+    wheel.arm(timer, TimingWheel::maxTicks * 2);
+    wheel.advance(TimingWheel::maxTicks - 1);
+    CHECK(wheel.count(timer) == 0);
+    wheel.advance(TimingWheel::maxTicks);
+    CHECK(wheel.count(timer) == 1);
+}
+
+void rearmAndCancel()
+{
+    Wheel   wheel;
+    Timer   moved;
+    Timer   cancelled;
+    wheel.arm(moved, 10);
+    wheel.arm(cancelled, 10);
+    wheel.arm(moved, 200);          // Moved to a higher level.
+    wheel.wheel.cancel(cancelled);
+    CHECK(!cancelled.armed());
+    {
+        Timer   destroyed;
+        wheel.arm(destroyed, 10);
+    }
+    wheel.advance(199);
+    CHECK(std::size(wheel.expired) == 0);
+    wheel.advance(201);
+    CHECK(wheel.count(moved) == 1);
+    CHECK(std::size(wheel.expired) == 1);
+
+    // Re-armed by the action: It fires again in a later tick (not the one being processed).
+    Timer       repeat;
+    std::size_t fired = 0;
+    wheel.arm(repeat, 1);
+    for (std::uint64_t tick = 202; tick < 210; ++tick)
+    {
+        std::size_t firedThisTick = 0;
+        wheel.wheel.advance(wheel.start + tick * resolution, [&](Timer& timer)
+        {
+            ++firedThisTick;
+            if (++fired < 3) {
+                wheel.wheel.arm(timer, resolution);
+            }
+        });
+        CHECK(firedThisTick <= 1);
+    }
+    CHECK(fired == 3);
+    CHECK(!repeat.armed());
+}
+
+int main()
+{
+    expiry();
+    cascade();
+    clamp();
+    rearmAndCancel();
+    std::cout << "TimingWheelTest: OK\n";
+}
@@ -1,4 +1,7 @@
 #include "../V1/Stream.h"
+#include "../V1/ContentStore.h"
+#include "../V1/HTTPStuff.h"
+#include "../V1/Logger.h"
 #include "../V2/ServerInit.h"
 #include "../V4/JobQueue.h"
 #include "../V5/EventHandler.h"
@@ -14,6 +17,17 @@
 #include <exception>
 #include <mutex>
 #include <map>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <string_view>
+#include <chrono>
+
+#include <sys/socket.h>
+#include <pthread.h>
+#include <sched.h>
 
 namespace TASock    = ThorsAnvil::ThorsSocket;
 
@@ -21,7 +35,25 @@ namespace TASock    = ThorsAnvil::ThorsSocket;
  * Class Declarations:
  *
  *      Socket:             An implementation of Stream Interface using TASock::SocketStream
+ *                          It tracks where it is in the request so the correct timeout is used
+ *                          when the coroutine yields to wait for data:
+ *                              Waiting:    idleTimeout for the first byte of the next request.
+ *                              Headers:    The request headers must be complete by headerTimeout
+ *                                          after the first byte (or after the connection is accepted).
+ *                              Body:       idleTimeout for each wait while the request is handled.
+ *      Reactor:            An event loop with its own connection table and JobQueue.
+ *                          A connection is owned by one Reactor for its whole life.
+ *                          When a timeout expires the socket is shut down and the coroutine resumed,
+ *                          so its read (or write) fails and the connection is cleaned up normally.
  *      WebServer:          A class to represent and manage incoming connections.
+ *                          The first Reactor listens for new connections and hands each one to a
+ *                          Reactor in turn (round robin).
+ *                          Connections past "maxConnections" are closed as soon as they are accepted.
+ *
+ *                          With one Reactor (the default) there is a single event loop and a shared
+ *                          pool of workers. With "-r <count>" there are <count> Reactors each with one
+ *                          worker, and each Reactor's threads are pinned to one core ("-r 0" uses
+ *                          one Reactor per core).
  *
  */
 
@@ -29,47 +61,85 @@ namespace TASock    = ThorsAnvil::ThorsSocket;
 enum class TaskYieldState        {RestoreRead, RestoreWrite, Remove};
 struct TaskYieldAction
 {
-    TaskYieldState      state;
-    int                 fd;
+    TaskYieldState              state;
+    int                         fd;
+    std::chrono::milliseconds   timeout;
 };
 
 using CoRoutine     = boost::coroutines2::coroutine<TaskYieldAction>::pull_type;
 using Yield         = boost::coroutines2::coroutine<TaskYieldAction>::push_type;
 
-class Socket: public Stream
+class Socket final: public Stream
 {
+    using Clock = std::chrono::steady_clock;
+    enum class Phase {Waiting, Headers, Body};
+
     TASock::SocketStream    stream;
+    ConnectionLimits const* limits;
+    std::string             line;
+    Phase                   phase;
+    Clock::time_point       headerDeadline;
     public:
-        Socket(TASock::SocketStream&& stream)
+        Socket(TASock::SocketStream&& stream, ConnectionLimits const& limits)
             : stream(std::move(stream))
+            , limits(&limits)
+            , phase(Phase::Headers)
+            , headerDeadline(Clock::now() + limits.headerTimeout)
         {}
 
         virtual std::string_view    getNextLine()               override
         {
-            static std::string line;
             std::getline(stream, line);
             return line;
         }
         virtual void ignore(std::size_t size)                   override {stream.ignore(size);}
-        virtual void sendMessage(std::string const& message)    override {stream << message;}
+        virtual std::size_t readBody(char* buffer, std::size_t size)    override {stream.read(buffer, size);return stream.gcount();}
+        virtual void sendMessage(std::string_view message)      override {stream << message;}
         virtual void sync()                                     override {stream.sync();}
         virtual bool hasData()  const                           override {return static_cast<bool>(stream);}
         virtual void close()                                    override {stream.close();}
+        virtual void headersComplete()                          override {phase = Phase::Body;}
+        virtual void requestComplete()                          override {phase = Phase::Waiting;}
 
         TASock::Socket& getSocket()                                      {return stream.getSocket();}
+
+        // How long to wait for the socket to become readable.
+        std::chrono::milliseconds readTimeout() const
+        {
+            if (phase != Phase::Headers) {
+                return limits->idleTimeout;
+            }
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(headerDeadline - Clock::now());
+            return std::max(remaining, std::chrono::milliseconds{0});
+        }
+        std::chrono::milliseconds writeTimeout() const  {return limits->idleTimeout;}
+        // True between reading the first line of a request and sending the response.
+        bool inRequest() const                          {return phase != Phase::Waiting;}
+        // Called when the coroutine resumes after waiting to read.
+        void readResumed()
+        {
+            if (phase == Phase::Waiting)
+            {
+                // The next request has started: Its headers must arrive in time.
+                phase           = Phase::Headers;
+                headerDeadline  = Clock::now() + limits->headerTimeout;
+            }
+        }
 };
 
 struct SocketInfo
 {
     Socket                  socket;
     CoRoutine               work;
+    bool                    started = false;    // The coroutine has run (and is suspended).
 };
 
-class WebServer
+class Reactor
 {
-    TASock::Server                      connection;
-    bool                                finished;
-    std::filesystem::path const&        contentDir;
+    ContentStore&                       contentStore;
+    ConnectionLimits const&             limits;
+    std::atomic<std::size_t>&           openCount;      // Shared by all Reactors (for maxConnections).
+    int                                 core;           // -1: Not pinned.
     // State information that can be used by the threads.
     // Objects placed in a std::map are not moved once inserted so taking
     // a reference to them is safe and can be used by another thread.
@@ -79,12 +149,33 @@ class WebServer
     JobQueue                            jobQueue;
     EventHandler                        eventHandler;
     public:
-        WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir);
+        Reactor(std::size_t workerCount, int core, ContentStore& contentStore, ConnectionLimits const& limits, std::atomic<std::size_t>& openCount);
+
+        void            run();
+        // Take ownership of a newly accepted connection (called from the listening Reactor).
+        void            adopt(TASock::SocketStream&& socketStream);
+        EventHandler&   getEventHandler()   {return eventHandler;}
+    private:
+        void normalConnectionHandler(int fd);
+        void timeoutConnectionHandler(int fd);
+        void closeConnection(int fd);
+};
+
+class WebServer
+{
+    TASock::Server                      connection;
+    bool                                finished;
+    ConnectionLimits                    limits;
+    ContentStore                        contentStore;
+    std::atomic<std::size_t>            openCount;
+    std::deque<Reactor>                 reactors;
+    std::size_t                         nextReactor;
+    public:
+        WebServer(std::size_t reactorCount, std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir, ConnectionLimits const& limits = ConnectionLimits{});
 
         void run();
     private:
         void newConnectionHandler(int fd);
-        void normalConnectionHandler(int fd);
 };
 
 int main(int argc, char* argv[])
@@ -92,9 +183,28 @@ int main(int argc, char* argv[])
     loguru::g_stderr_verbosity = 9;
     static constexpr std::size_t workerCount = 4;
 
+    // Optional: -r <reactors>
+    //           -l <logFile>   Append the log to <logFile> (rather than stderr).
+    std::size_t reactorCount = 1;
+    while (argc >= 3 && (argv[1] == std::string_view{"-r"} || argv[1] == std::string_view{"-l"}))
+    {
+        if (argv[1] == std::string_view{"-l"}) {
+            Logger::instance().setOutput(argv[2]);
+        }
+        else
+        {
+            reactorCount = std::stoul(argv[2]);
+            if (reactorCount == 0) {
+                reactorCount = std::max(1U, std::thread::hardware_concurrency());
+            }
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
     if (argc != 4 && argc != 3)
     {
-        std::cerr << "Usage: NisseV1 <port> <documentPath> [<SSL Certificate Path>]" << "\n";
+        std::cerr << "Usage: NisseV1 [-r <reactors>] [-l <logFile>] <port> <documentPath> [<SSL Certificate Path>]" << "\n";
         return 1;
     }
 
@@ -108,7 +218,8 @@ int main(int argc, char* argv[])
         }
 
         std::cout << "Nisse Proto 6\n";
-        WebServer   server(workerCount, getServerInit(port, certDir), contentDir);
+        // One Reactor shares the pool of workers. Multiple Reactors get one worker each.
+        WebServer   server(reactorCount, reactorCount == 1 ? workerCount : 1, getServerInit(port, certDir), contentDir);
         server.run();
     }
     catch(std::exception const& e)
@@ -127,30 +238,50 @@ int main(int argc, char* argv[])
  * Class Implementation:
  */
 
-// WebServer
-// =========
-WebServer::WebServer(std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir)
-    : connection{std::move(serverInit)}
-    , finished{false}
-    , contentDir{contentDir}
+// Pin the calling thread to "core" (no effect if "core" is -1).
+static void pinToCore(int core)
+{
+#ifdef __linux__
+    if (core == -1) {
+        return;
+    }
+    cpu_set_t   cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) {
+        NISSE_LOG(Warning, "Failed to pin thread to core: ", core);
+    }
+#else
+    (void)core;
+#endif
+}
+
+// Reactor
+// =======
+Reactor::Reactor(std::size_t workerCount, int core, ContentStore& contentStore, ConnectionLimits const& limits, std::atomic<std::size_t>& openCount)
+    : contentStore{contentStore}
+    , limits{limits}
+    , openCount{openCount}
+    , core{core}
     , jobQueue{workerCount}
     , eventHandler{jobQueue}
-{}
+{
+    // With a single worker this job runs on it: So the worker is pinned as well.
+    if (core != -1) {
+        jobQueue.addJob([core](){pinToCore(core);});
+    }
+}
 
-void WebServer::run()
+void Reactor::run()
 {
-    std::cerr << "Listen to: " << connection.socketId() << "\n";
-    eventHandler.add(connection.socketId(), [&](int fd){this->newConnectionHandler(fd);});
+    pinToCore(core);
     eventHandler.run();
 }
 
-void WebServer::newConnectionHandler(int)
+void Reactor::adopt(TASock::SocketStream&& socketStream)
 {
-    std::cerr << "newConnectionHandler\n";
-    // Main thread waits for a new connection.
-    TASock::SocketStream socketStream = connection.accept();
     int fd = socketStream.getSocket().socketId();
-    Socket newSocket(std::move(socketStream));
+    Socket newSocket(std::move(socketStream), limits);
 
     // Add the “newSocket” into the std::map object “openSockets”
     std::unique_lock<std::mutex>    lock(openSocketMutex);
@@ -158,36 +289,120 @@ void WebServer::newConnectionHandler(int)
     static CoRoutine    invalid{[](Yield&){}};
 
     auto [iter, ok] = openSockets.insert_or_assign(fd, SocketInfo{std::move(newSocket), std::move(invalid)});
-    iter->second.work = CoRoutine{[fd, &contentDir = this->contentDir, &webServer = *this, &socket = iter->second.socket](Yield& yield)
+    iter->second.work = CoRoutine{[fd, &contentStore = this->contentStore, &socket = iter->second.socket](Yield& yield)
     {
-        std::cerr << "Job Running\n";
-        socket.getSocket().setReadYield([&yield, fd](){yield(TaskYieldAction{TaskYieldState::RestoreRead, fd});return true;});
-        socket.getSocket().setWriteYield([&yield, fd](){yield(TaskYieldAction{TaskYieldState::RestoreWrite, fd});return true;});
-        handleConnection(socket, contentDir);
-        yield(TaskYieldAction{TaskYieldState::Remove, fd});
+        NISSE_LOG(Debug, "Job Running");
+        socket.getSocket().setReadYield([&yield, &socket, fd](){yield(TaskYieldAction{TaskYieldState::RestoreRead, fd, socket.readTimeout()});socket.readResumed();return true;});
+        socket.getSocket().setWriteYield([&yield, &socket, fd](){yield(TaskYieldAction{TaskYieldState::RestoreWrite, fd, socket.writeTimeout()});return true;});
+        handleConnection(socket, contentStore);
+        yield(TaskYieldAction{TaskYieldState::Remove, fd, EventHandler::noTimeout});
     }};
 
-    eventHandler.add(fd, [&](int fd){this->normalConnectionHandler(fd);});
+    eventHandler.add(fd,
+                     [&](int fd){this->normalConnectionHandler(fd);},
+                     [&](int fd){this->timeoutConnectionHandler(fd);},
+                     limits.headerTimeout);
 }
 
-void WebServer::normalConnectionHandler(int fd)
+void Reactor::normalConnectionHandler(int fd)
 {
-    std::cerr << "normalConnectionHandler\n";
+    NISSE_LOG(Debug, "normalConnectionHandler");
+    std::unique_lock<std::mutex>    lock(openSocketMutex);
     auto find = openSockets.find(fd);
-    jobQueue.addJob([&webServer = *this, fd, &work = find->second.work](){
+    // Finishing a request that is in progress comes before starting a new one.
+    // Note: The coroutine is suspended so its state can be read here.
+    SocketInfo&         info        = find->second;
+    JobQueue::Priority  priority    = info.started && info.socket.inRequest() ? JobQueue::Priority::High : JobQueue::Priority::Normal;
+    info.started = true;
+    jobQueue.addJob([&reactor = *this, fd, &work = info.work](){
         TaskYieldAction action = work.get();
         switch (action.state)
         {
             case TaskYieldState::RestoreRead:
-                webServer.eventHandler.restore(fd, true);
+                reactor.eventHandler.restore(fd, true, action.timeout);
                 break;
             case TaskYieldState::RestoreWrite:
-                webServer.eventHandler.restore(fd, false);
+                reactor.eventHandler.restore(fd, false, action.timeout);
                 break;
             case TaskYieldState::Remove:
-                //webServer.openSockets.erase(fd);
+                // Note: This destroys the coroutine (and "work").
+                //       It is suspended at its last yield so nothing on its stack is still in use.
+                reactor.closeConnection(fd);
                 break;
         }
-    });
+    }, priority);
 }
 
+void Reactor::timeoutConnectionHandler(int fd)
+{
+    // The coroutine is suspended waiting for the socket.
+    // Shut the socket down and resume it: The read (or write) fails, handleConnection()
+    // returns and the connection is removed as normal.
+    NISSE_LOG(Info, "Connection Timeout: ", fd);
+    ::shutdown(fd, SHUT_RDWR);
+    normalConnectionHandler(fd);
+}
+
+void Reactor::closeConnection(int fd)
+{
+    // Stop listening before the socket is closed (the number can be reused).
+    eventHandler.remove(fd);
+    std::unique_lock<std::mutex>    lock(openSocketMutex);
+    openSockets.erase(fd);
+    --openCount;
+}
+
+// WebServer
+// =========
+WebServer::WebServer(std::size_t reactorCount, std::size_t workerCount, TASock::ServerInit&& serverInit, std::filesystem::path const& contentDir, ConnectionLimits const& limits)
+    : connection{std::move(serverInit)}
+    , finished{false}
+    , limits{limits}
+    , contentStore{contentDir}
+    , openCount{0}
+    , nextReactor{0}
+{
+    unsigned const  cores = std::thread::hardware_concurrency();
+    for (std::size_t loop = 0; loop < reactorCount; ++loop)
+    {
+        int core = (reactorCount == 1 || cores == 0) ? -1 : static_cast<int>(loop % cores);
+        reactors.emplace_back(workerCount, core, contentStore, this->limits, openCount);
+    }
+}
+
+void WebServer::run()
+{
+    NISSE_LOG(Info, "Listen to: ", connection.socketId(), " Reactors: ", std::size(reactors));
+    reactors[0].getEventHandler().add(connection.socketId(), [&](int fd){this->newConnectionHandler(fd);});
+
+    // The first Reactor runs on this thread.
+    std::vector<std::thread>    threads;
+    for (std::size_t loop = 1; loop < std::size(reactors); ++loop) {
+        threads.emplace_back(&Reactor::run, &reactors[loop]);
+    }
+    reactors[0].run();
+    for (auto& thread: threads) {
+        thread.join();
+    }
+}
+
+void WebServer::newConnectionHandler(int listenFd)
+{
+    NISSE_LOG(Debug, "newConnectionHandler");
+    // Main thread waits for a new connection.
+    TASock::SocketStream socketStream = connection.accept();
+    int fd = socketStream.getSocket().socketId();
+    // The read event is not persistent: Listen for the next connection.
+    reactors[0].getEventHandler().restore(listenFd, true);
+
+    if (openCount >= limits.maxConnections)
+    {
+        NISSE_LOG(Warning, "Connection limit reached: Closing: ", fd);
+        // Note: socketStream is closed when it goes out of scope.
+        return;
+    }
+    ++openCount;
+    // Hand the connection to the next Reactor: It stays there until it is closed.
+    reactors[nextReactor].adopt(std::move(socketStream));
+    nextReactor = (nextReactor + 1) % std::size(reactors);
+}